@@ -0,0 +1,488 @@
+#pragma once
+
+// Collision counting engines used by the hash quality tests.
+//
+// All of them have the same interface:
+//   Begin(entryCount, bucketCount) - prepare for entryCount hashes; bucketCount is the hashtable size
+//   Add(hash)                      - feed one hash value
+//   End(outUniqueHashes, outUsedBuckets) - produce the number of distinct hash values, and
+//                                    the number of distinct (hash % bucketCount) buckets
+//   GetRelativeError()             - relative standard error of the End() results; 0 for exact engines
+//
+// - SetCollisionCounter: reference implementation, two std::sets. One node allocation per
+//   entry and per bucket, so slow and memory hungry on large data sets.
+// - SortCollisionCounter: hashes go into a flat array that is radix sorted, then adjacent
+//   duplicates are counted; buckets are tracked in a bitmap of bucketCount bits. Allocation
+//   free after Begin, and around 2*sizeof(hash) bytes per entry plus 1 bit per bucket.
+// - EstimateCollisionCounter: counts exactly while there are few entries, and then switches to
+//   HyperLogLog estimates of both counts; fixed memory use (under 2MB) no matter how many entries.
+//
+// BucketReductionCounter is separate from the above: it counts used buckets for several ways of
+// turning a hash into a bucket index ("reductions"), at several table load factors, exactly.
+
+#include <vector>
+#include <set>
+#include <string.h>
+#include <stdint.h>
+#include <stddef.h>
+#include <math.h>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#	define COLLISION_COUNTERS_SSE2 1
+#	include <emmintrin.h>
+#endif
+#if defined(_MSC_VER) && defined(_M_X64)
+#	include <intrin.h>
+#endif
+
+
+template<typename HashType>
+class SetCollisionCounter
+{
+public:
+	void Begin(size_t /*entryCount*/, size_t bucketCount)
+	{
+		m_BucketCount = bucketCount;
+		m_Uniq.clear();
+		m_UniqModulo.clear();
+	}
+	void Add(HashType h)
+	{
+		m_Uniq.insert(h);
+		m_UniqModulo.insert(h % m_BucketCount);
+	}
+	void End(size_t& outUniqueHashes, size_t& outUsedBuckets)
+	{
+		outUniqueHashes = m_Uniq.size();
+		outUsedBuckets = m_UniqModulo.size();
+	}
+	double GetRelativeError() const { return 0; }
+
+private:
+	size_t m_BucketCount;
+	std::set<HashType> m_Uniq;
+	std::set<HashType> m_UniqModulo;
+};
+
+
+// LSD radix sort on 8 bit digits; ping-pongs between data and scratch (both of same size),
+// result ends up in data. Digit passes where all values have the same digit are skipped.
+template<typename T>
+void RadixSort(std::vector<T>& data, std::vector<T>& scratch)
+{
+	const size_t count = data.size();
+	scratch.resize(count);
+	T* src = data.data();
+	T* dst = scratch.data();
+	for (size_t shift = 0; shift < sizeof(T) * 8; shift += 8)
+	{
+		size_t offsets[256];
+		memset(offsets, 0, sizeof(offsets));
+		for (size_t i = 0; i < count; ++i)
+			++offsets[(src[i] >> shift) & 0xFF];
+		if (count == 0 || offsets[(src[0] >> shift) & 0xFF] == count)
+			continue;
+		size_t sum = 0;
+		for (int d = 0; d < 256; ++d)
+		{
+			size_t c = offsets[d];
+			offsets[d] = sum;
+			sum += c;
+		}
+		for (size_t i = 0; i < count; ++i)
+		{
+			T v = src[i];
+			dst[offsets[(v >> shift) & 0xFF]++] = v;
+		}
+		T* tmp = src; src = dst; dst = tmp;
+	}
+	if (src != data.data())
+		memcpy(data.data(), src, count * sizeof(T));
+}
+
+
+template<typename HashType>
+class SortCollisionCounter
+{
+public:
+	void Begin(size_t entryCount, size_t bucketCount)
+	{
+		m_BucketCount = bucketCount;
+		m_UsedBuckets = 0;
+		m_Hashes.clear();
+		m_Hashes.reserve(entryCount);
+		m_Scratch.reserve(entryCount);
+		m_Buckets.assign((bucketCount + 63) / 64, 0);
+	}
+	void Add(HashType h)
+	{
+		m_Hashes.push_back(h);
+		size_t bucket = (size_t)(h % m_BucketCount);
+		uint64_t& word = m_Buckets[bucket / 64];
+		uint64_t bit = uint64_t(1) << (bucket & 63);
+		m_UsedBuckets += (word & bit) == 0;
+		word |= bit;
+	}
+	void End(size_t& outUniqueHashes, size_t& outUsedBuckets)
+	{
+		RadixSort(m_Hashes, m_Scratch);
+		size_t uniq = m_Hashes.empty() ? 0 : 1;
+		for (size_t i = 1, n = m_Hashes.size(); i < n; ++i)
+			uniq += m_Hashes[i] != m_Hashes[i-1];
+		outUniqueHashes = uniq;
+		outUsedBuckets = m_UsedBuckets;
+	}
+	double GetRelativeError() const { return 0; }
+
+private:
+	size_t m_BucketCount;
+	size_t m_UsedBuckets;
+	std::vector<HashType> m_Hashes;
+	std::vector<HashType> m_Scratch;
+	std::vector<uint64_t> m_Buckets; // bitmap, one bit per bucket
+};
+
+
+// HyperLogLog distinct value estimator with 2^14 registers (relative standard error 1.04/sqrt(2^14),
+// i.e. ~0.8%). Values are remixed first, so even poor input hashes spread over the registers.
+// The estimate uses the "improved raw estimator" from Otmar Ertl, "New cardinality estimation
+// algorithms for HyperLogLog sketches" (2017), which needs no bias correction tables and is
+// accurate from tiny to huge cardinalities. Several estimators fed from disjoint shards of the
+// same data can be combined with Merge.
+class HyperLogLog
+{
+public:
+	enum { kPrecision = 14, kRegisterCount = 1 << kPrecision, kMaxRank = 64 - kPrecision + 1 };
+
+	HyperLogLog() { Clear(); }
+
+	void Clear() { memset(m_Registers, 0, sizeof(m_Registers)); }
+
+	void Add(uint64_t value)
+	{
+		uint64_t x = Mix(value);
+		uint32_t index = (uint32_t)(x >> (64 - kPrecision));
+		uint64_t rest = (x << kPrecision) | (uint64_t(1) << (kPrecision - 1)); // guard bit: rank <= kMaxRank
+		uint8_t rank = (uint8_t)(CountLeadingZeros(rest) + 1);
+		if (rank > m_Registers[index])
+			m_Registers[index] = rank;
+	}
+
+	// register-wise max, 16 registers at a time
+	void Merge(const HyperLogLog& other)
+	{
+#		if COLLISION_COUNTERS_SSE2
+		for (int i = 0; i < kRegisterCount; i += 16)
+		{
+			__m128i a = _mm_loadu_si128((const __m128i*)(m_Registers + i));
+			__m128i b = _mm_loadu_si128((const __m128i*)(other.m_Registers + i));
+			_mm_storeu_si128((__m128i*)(m_Registers + i), _mm_max_epu8(a, b));
+		}
+#		else
+		for (int i = 0; i < kRegisterCount; ++i)
+			if (other.m_Registers[i] > m_Registers[i])
+				m_Registers[i] = other.m_Registers[i];
+#		endif
+	}
+
+	double Estimate() const
+	{
+		int histogram[kMaxRank + 1];
+		memset(histogram, 0, sizeof(histogram));
+		for (int i = 0; i < kRegisterCount; ++i)
+			++histogram[m_Registers[i]];
+		const double m = kRegisterCount;
+		double z = m * Tau(1.0 - histogram[kMaxRank] / m);
+		for (int k = kMaxRank - 1; k >= 1; --k)
+		{
+			z += histogram[k];
+			z *= 0.5;
+		}
+		z += m * Sigma(histogram[0] / m);
+		const double alpha = 0.5 / log(2.0);
+		return alpha * m * m / z;
+	}
+
+	static double GetRelativeError() { return 1.04 / sqrt((double)kRegisterCount); }
+
+private:
+	static uint64_t Mix(uint64_t k)
+	{
+		// MurmurHash3 fmix64; a bijection, so distinct values stay distinct
+		k ^= k >> 33;
+		k *= 0xff51afd7ed558ccdULL;
+		k ^= k >> 33;
+		k *= 0xc4ceb9fe1a85ec53ULL;
+		k ^= k >> 33;
+		return k;
+	}
+	static int CountLeadingZeros(uint64_t v)
+	{
+		int n = 0;
+		while (!(v & (uint64_t(1) << 63)))
+		{
+			v <<= 1;
+			++n;
+		}
+		return n;
+	}
+	static double Sigma(double x)
+	{
+		if (x == 1.0)
+			return HUGE_VAL;
+		double y = 1.0, z = x, prevZ;
+		do
+		{
+			x *= x;
+			prevZ = z;
+			z += x * y;
+			y += y;
+		} while (z != prevZ);
+		return z;
+	}
+	static double Tau(double x)
+	{
+		if (x == 0.0 || x == 1.0)
+			return 0.0;
+		double y = 1.0, z = 1.0 - x, prevZ;
+		do
+		{
+			x = sqrt(x);
+			prevZ = z;
+			y *= 0.5;
+			z -= (1.0 - x) * (1.0 - x) * y;
+		} while (z != prevZ);
+		return z / 3.0;
+	}
+
+	uint8_t m_Registers[kRegisterCount];
+};
+
+
+template<typename HashType>
+class EstimateCollisionCounter
+{
+public:
+	enum { kExactLimit = 1 << 16 }; // up to this many entries counts are exact
+
+	void Begin(size_t /*entryCount*/, size_t bucketCount)
+	{
+		m_BucketCount = bucketCount;
+		m_Estimating = false;
+		m_Hashes.clear();
+		m_Buckets.clear();
+		m_Hashes.reserve(kExactLimit);
+		m_Buckets.reserve(kExactLimit);
+		m_UniqueHLL.Clear();
+		m_BucketHLL.Clear();
+	}
+	void Add(HashType h)
+	{
+		HashType bucket = (HashType)(h % m_BucketCount);
+		if (m_Estimating)
+		{
+			m_UniqueHLL.Add(h);
+			m_BucketHLL.Add(bucket);
+			return;
+		}
+		m_Hashes.push_back(h);
+		m_Buckets.push_back(bucket);
+		if (m_Hashes.size() == kExactLimit)
+			SwitchToEstimating();
+	}
+	// Combine with a counter that saw a disjoint part of the same data (same bucket count)
+	void Merge(const EstimateCollisionCounter& other)
+	{
+		if (!other.m_Estimating)
+		{
+			for (size_t i = 0; i < other.m_Hashes.size(); ++i)
+				Add(other.m_Hashes[i]);
+			return;
+		}
+		if (!m_Estimating)
+			SwitchToEstimating();
+		m_UniqueHLL.Merge(other.m_UniqueHLL);
+		m_BucketHLL.Merge(other.m_BucketHLL);
+	}
+	void End(size_t& outUniqueHashes, size_t& outUsedBuckets)
+	{
+		if (m_Estimating)
+		{
+			outUniqueHashes = (size_t)(m_UniqueHLL.Estimate() + 0.5);
+			outUsedBuckets = (size_t)(m_BucketHLL.Estimate() + 0.5);
+			return;
+		}
+		outUniqueHashes = CountUnique(m_Hashes, m_Scratch);
+		outUsedBuckets = CountUnique(m_Buckets, m_Scratch);
+	}
+	double GetRelativeError() const { return m_Estimating ? HyperLogLog::GetRelativeError() : 0; }
+
+private:
+	void SwitchToEstimating()
+	{
+		for (size_t i = 0; i < m_Hashes.size(); ++i)
+		{
+			m_UniqueHLL.Add(m_Hashes[i]);
+			m_BucketHLL.Add(m_Buckets[i]);
+		}
+		m_Estimating = true;
+		// not needed anymore; there can be one counter per shard, see Merge
+		std::vector<HashType>().swap(m_Hashes);
+		std::vector<HashType>().swap(m_Buckets);
+	}
+	static size_t CountUnique(std::vector<HashType>& values, std::vector<HashType>& scratch)
+	{
+		RadixSort(values, scratch);
+		size_t uniq = values.empty() ? 0 : 1;
+		for (size_t i = 1, n = values.size(); i < n; ++i)
+			uniq += values[i] != values[i-1];
+		return uniq;
+	}
+
+	size_t m_BucketCount;
+	bool m_Estimating;
+	std::vector<HashType> m_Hashes; // exact phase only
+	std::vector<HashType> m_Buckets;
+	std::vector<HashType> m_Scratch;
+	HyperLogLog m_UniqueHLL;
+	HyperLogLog m_BucketHLL;
+};
+
+
+// Ways to reduce a hash to a bucket index in [0, tableSize):
+// - mask: low hash bits; power of two table size
+// - prime: hash modulo a prime table size
+// - fastrange: Lemire's multiply-shift, (hash * tableSize) >> hash bits; any table size, uses the high hash bits
+// - fibonacci: (hash * 2^bits/phi) >> (bits - log2(tableSize)); power of two size, all hash bits affect the index
+enum BucketReduction
+{
+	kReductionMask,
+	kReductionPrime,
+	kReductionFastrange,
+	kReductionFibonacci,
+	kReductionCount
+};
+static const char* kBucketReductionNames[kReductionCount] = { "mask", "prime", "fastrange", "fibonacci" };
+static const double kReductionLoadFactors[] = { 0.25, 0.5, 0.75, 1.0 };
+enum { kReductionLoadFactorCount = sizeof(kReductionLoadFactors) / sizeof(kReductionLoadFactors[0]) };
+
+static bool IsPrime(size_t n)
+{
+	if (n < 2)
+		return false;
+	for (size_t d = 2; d * d <= n; ++d)
+		if (n % d == 0)
+			return false;
+	return true;
+}
+
+// Table size each reduction would use for entryCount entries at (at most) loadFactor
+static size_t GetReductionTableSize(BucketReduction reduction, size_t entryCount, double loadFactor)
+{
+	size_t size = (size_t)ceil(entryCount / loadFactor);
+	if (size < 1)
+		size = 1;
+	switch (reduction)
+	{
+	case kReductionMask:
+	case kReductionFibonacci:
+		{
+			size_t pow2 = 1;
+			while (pow2 < size)
+				pow2 *= 2;
+			return pow2;
+		}
+	case kReductionPrime:
+		while (!IsPrime(size))
+			++size;
+		return size;
+	default:
+		return size;
+	}
+}
+
+static inline uint64_t MulHigh64(uint64_t a, uint64_t b)
+{
+#	if defined(__SIZEOF_INT128__)
+	return (uint64_t)(((unsigned __int128)a * b) >> 64);
+#	elif defined(_MSC_VER) && defined(_M_X64)
+	return __umulh(a, b);
+#	else
+	uint64_t aLo = (uint32_t)a, aHi = a >> 32, bLo = (uint32_t)b, bHi = b >> 32;
+	uint64_t mid1 = aHi * bLo + ((aLo * bLo) >> 32);
+	uint64_t mid2 = aLo * bHi + (uint32_t)mid1;
+	return aHi * bHi + (mid1 >> 32) + (mid2 >> 32);
+#	endif
+}
+
+// sizeBits is log2(tableSize) for the power of two reductions
+static inline size_t ReduceHash(uint32_t h, BucketReduction reduction, size_t tableSize, int sizeBits)
+{
+	switch (reduction)
+	{
+	case kReductionMask: return h & (tableSize - 1);
+	case kReductionPrime: return h % tableSize;
+	case kReductionFastrange: return (size_t)(((uint64_t)h * tableSize) >> 32);
+	default: return sizeBits ? (uint32_t)(h * 2654435769u) >> (32 - sizeBits) : 0;
+	}
+}
+static inline size_t ReduceHash(uint64_t h, BucketReduction reduction, size_t tableSize, int sizeBits)
+{
+	switch (reduction)
+	{
+	case kReductionMask: return (size_t)(h & (tableSize - 1));
+	case kReductionPrime: return (size_t)(h % tableSize);
+	case kReductionFastrange: return (size_t)MulHigh64(h, tableSize);
+	default: return sizeBits ? (size_t)((h * 11400714819323198485ull) >> (64 - sizeBits)) : 0;
+	}
+}
+
+
+// Used buckets for every reduction & load factor combination, each tracked in its own bitmap
+// (1 bit per bucket; up to around 7 bytes per entry for all of them together).
+template<typename HashType>
+class BucketReductionCounter
+{
+public:
+	enum { kTableCount = kReductionLoadFactorCount * kReductionCount };
+
+	void Begin(size_t entryCount)
+	{
+		for (int t = 0; t < kTableCount; ++t)
+		{
+			Table& table = m_Tables[t];
+			table.reduction = (BucketReduction)(t % kReductionCount);
+			table.size = GetReductionTableSize(table.reduction, entryCount, kReductionLoadFactors[t / kReductionCount]);
+			table.sizeBits = 0;
+			while ((size_t(1) << table.sizeBits) < table.size)
+				++table.sizeBits;
+			table.usedBuckets = 0;
+			table.buckets.assign((table.size + 63) / 64, 0);
+		}
+	}
+	void Add(HashType h)
+	{
+		for (int t = 0; t < kTableCount; ++t)
+		{
+			Table& table = m_Tables[t];
+			size_t bucket = ReduceHash(h, table.reduction, table.size, table.sizeBits);
+			uint64_t& word = table.buckets[bucket / 64];
+			uint64_t bit = uint64_t(1) << (bucket & 63);
+			table.usedBuckets += (word & bit) == 0;
+			word |= bit;
+		}
+	}
+	size_t GetTableSize(int loadFactorIndex, BucketReduction reduction) const { return m_Tables[loadFactorIndex * kReductionCount + reduction].size; }
+	size_t GetUsedBuckets(int loadFactorIndex, BucketReduction reduction) const { return m_Tables[loadFactorIndex * kReductionCount + reduction].usedBuckets; }
+
+private:
+	struct Table
+	{
+		BucketReduction reduction;
+		size_t size;
+		int sizeBits;
+		size_t usedBuckets;
+		std::vector<uint64_t> buckets; // bitmap
+	};
+	Table m_Tables[kTableCount];
+};
@@ -0,0 +1,193 @@
+#include "Platform.h"
+
+#include <stdio.h>
+
+//-----------------------------------------------------------------------------
+// Pin the calling thread to a single CPU core, so that timing measurements
+// don't bounce between cores (and their caches / clock domains).
+
+#if defined(_MSC_VER)
+
+#include <windows.h>
+#include <vector>
+
+void SetAffinity ( int cpu )
+{
+  if(cpu < 0)
+  {
+    DWORD_PTR processMask, systemMask;
+    if(GetProcessAffinityMask(GetCurrentProcess(), &processMask, &systemMask))
+      SetThreadAffinityMask(GetCurrentThread(), processMask);
+    return;
+  }
+  SetThreadAffinityMask(GetCurrentThread(), DWORD_PTR(1) << cpu);
+  SetThreadPriority(GetCurrentThread(), THREAD_PRIORITY_HIGHEST);
+}
+
+int GetCpuPlacementOrder ( bool smtSiblingsFirst, int * outCpus, int maxCpus )
+{
+  DWORD size = 0;
+  GetLogicalProcessorInformation(NULL, &size);
+  std::vector<SYSTEM_LOGICAL_PROCESSOR_INFORMATION> info(size / sizeof(SYSTEM_LOGICAL_PROCESSOR_INFORMATION));
+  if(info.empty() || !GetLogicalProcessorInformation(info.data(), &size))
+    return 0;
+
+  // per physical core, the mask of its hardware threads (only the first processor group)
+  std::vector<ULONG_PTR> cores;
+  for(size_t i = 0; i < info.size(); i++)
+    if(info[i].Relationship == RelationProcessorCore)
+      cores.push_back(info[i].ProcessorMask);
+
+  int count = 0;
+  if(smtSiblingsFirst)
+  {
+    for(size_t c = 0; c < cores.size(); c++)
+      for(int cpu = 0; cpu < (int)sizeof(ULONG_PTR) * 8 && count < maxCpus; cpu++)
+        if(cores[c] & (ULONG_PTR(1) << cpu))
+          outCpus[count++] = cpu;
+    return count;
+  }
+  // n-th hardware thread of every core, for n = 0, 1, ...
+  for(int sibling = 0; ; sibling++)
+  {
+    bool any = false;
+    for(size_t c = 0; c < cores.size(); c++)
+    {
+      int index = 0;
+      for(int cpu = 0; cpu < (int)sizeof(ULONG_PTR) * 8; cpu++)
+      {
+        if(!(cores[c] & (ULONG_PTR(1) << cpu)))
+          continue;
+        if(index++ == sibling && count < maxCpus)
+        {
+          outCpus[count++] = cpu;
+          any = true;
+        }
+      }
+    }
+    if(!any)
+      return count;
+  }
+}
+
+#elif defined(__linux__) && !defined(__EMSCRIPTEN__)
+
+#ifndef _GNU_SOURCE
+#define _GNU_SOURCE
+#endif
+#include <sched.h>
+#include <algorithm>
+
+// CPUs the process was started with, read during static initialization, i.e. before main
+// (and anything in it) pins the main thread; that pinning is inherited by new threads, and
+// sched_getaffinity only returns the mask of one thread.
+static cpu_set_t g_StartupAffinity;
+
+static bool ReadStartupAffinity ( )
+{
+  CPU_ZERO(&g_StartupAffinity);
+  return sched_getaffinity(0, sizeof(g_StartupAffinity), &g_StartupAffinity) == 0;
+}
+
+static const bool g_StartupAffinityKnown = ReadStartupAffinity();
+
+void SetAffinity ( int cpu )
+{
+  if(cpu < 0)
+  {
+    if(g_StartupAffinityKnown)
+      sched_setaffinity(0, sizeof(g_StartupAffinity), &g_StartupAffinity);
+    return;
+  }
+  cpu_set_t mask;
+  CPU_ZERO(&mask);
+  CPU_SET(cpu,&mask);
+  if( sched_setaffinity(0,sizeof(mask),&mask) == -1)
+    fprintf(stderr, "WARNING: Could not set CPU affinity to core %i\n", cpu);
+}
+
+static int ReadTopologyValue ( int cpu, const char * name )
+{
+  char path[128];
+  snprintf(path, sizeof(path), "/sys/devices/system/cpu/cpu%i/topology/%s", cpu, name);
+  FILE * f = fopen(path, "r");
+  if(!f)
+    return -1;
+  int value = -1;
+  if(fscanf(f, "%i", &value) != 1)
+    value = -1;
+  fclose(f);
+  return value;
+}
+
+struct CpuPlacement
+{
+  int cpu, package, core, sibling; // sibling: index of this hardware thread within its core
+  bool operator < ( const CpuPlacement & o ) const
+  {
+    if(sibling != o.sibling) return sibling < o.sibling;
+    if(package != o.package) return package < o.package;
+    if(core != o.core) return core < o.core;
+    return cpu < o.cpu;
+  }
+};
+
+static bool CompactOrder ( const CpuPlacement & a, const CpuPlacement & b )
+{
+  if(a.package != b.package) return a.package < b.package;
+  if(a.core != b.core) return a.core < b.core;
+  return a.cpu < b.cpu;
+}
+
+int GetCpuPlacementOrder ( bool smtSiblingsFirst, int * outCpus, int maxCpus )
+{
+  if(!g_StartupAffinityKnown)
+    return 0;
+  const cpu_set_t & allowed = g_StartupAffinity;
+
+  CpuPlacement cpus[CPU_SETSIZE];
+  int count = 0;
+  for(int cpu = 0; cpu < CPU_SETSIZE; cpu++)
+  {
+    if(!CPU_ISSET(cpu, &allowed))
+      continue;
+    CpuPlacement p;
+    p.cpu = cpu;
+    p.package = ReadTopologyValue(cpu, "physical_package_id");
+    p.core = ReadTopologyValue(cpu, "core_id");
+    p.sibling = 0;
+    if(p.core < 0)
+      return 0;
+    cpus[count++] = p;
+  }
+  std::sort(cpus, cpus + count, CompactOrder);
+  for(int i = 1; i < count; i++)
+  {
+    if(cpus[i].package == cpus[i-1].package && cpus[i].core == cpus[i-1].core)
+      cpus[i].sibling = cpus[i-1].sibling + 1;
+  }
+  if(!smtSiblingsFirst)
+    std::sort(cpus, cpus + count);
+
+  if(count > maxCpus)
+    count = maxCpus;
+  for(int i = 0; i < count; i++)
+    outCpus[i] = cpus[i].cpu;
+  return count;
+}
+
+#else
+
+void SetAffinity ( int /*cpu*/ )
+{
+  // no thread affinity API we can use (Apple, emscripten, consoles)
+}
+
+int GetCpuPlacementOrder ( bool /*smtSiblingsFirst*/, int * /*outCpus*/, int /*maxCpus*/ )
+{
+  return 0;
+}
+
+#endif
+
+//-----------------------------------------------------------------------------
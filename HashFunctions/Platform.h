@@ -3,8 +3,16 @@
 
 #pragma once
 
+// Pins the calling thread to one CPU; with cpu -1, unpins it again, i.e. lets it run on all the CPUs
+// the process was started with (new threads inherit the pinning of the thread creating them).
 void SetAffinity ( int cpu );
 
+// Fills outCpus with up to maxCpus CPU numbers (that this process was started with) in thread
+// placement order: one per physical core first, then their SMT siblings; or with
+// smtSiblingsFirst, all hardware threads of one core before moving to the next.
+// Returns the count, or 0 if the CPU topology is not known on this platform.
+int GetCpuPlacementOrder ( bool smtSiblingsFirst, int * outCpus, int maxCpus );
+
 //-----------------------------------------------------------------------------
 // Microsoft Visual Studio
 
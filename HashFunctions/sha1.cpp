@@ -119,9 +119,13 @@ void SHA1_Transform(uint32_t state[5], const uint8_t buffer[64])
         uint8_t c[64];
         uint32_t l[16];
     } CHAR64LONG16;
+    CHAR64LONG16 workspace;
     CHAR64LONG16* block;
 
-    block = (CHAR64LONG16*)buffer;
+    /* Work on a copy: the message schedule below is computed in place, and
+       the input must stay untouched (it is shared test data). */
+    block = &workspace;
+    memcpy(block, buffer, 64);
 
     /* Copy context->state[] to working vars */
     a = state[0];
@@ -0,0 +1,781 @@
+#pragma once
+
+// Hash table containers used by the hash table tests, to see how hash functions do in real
+// tables (where bit quality and hashing speed both matter), not just in a bucket collision model.
+//
+// Tables only store hash values and key indices; the keys themselves stay with the caller.
+// Operations take a key equality functor, equal(index), that says whether the key stored under
+// that index is the one being inserted or looked for. Stored hashes are compared first, so the
+// functor only gets called on full hash matches. Every operation also reports how many slots
+// it had to look at ("probes", 1 = found in the first slot looked at).
+//
+// - LinearProbingTable: open addressing with linear probing. Power of two capacity, and the
+//   home slot is the low bits of the hash, so weak low hash bits show up as long probe runs.
+//   Never resizes; callers size it for the number of keys, and it must never become full.
+// - SwissTable: in the style of Abseil's flat_hash_map / "Swiss tables". Slots are in groups of
+//   16, with one control byte per slot: a 7 bit tag (H2, low hash bits) or "empty". A lookup
+//   compares the tag against all 16 control bytes of a group at once (SSE2), and only checks
+//   slots whose tag matched. Group index (H1) is the hash bits above the tag; groups are probed
+//   in triangular steps. Tag matches of other keys ("false positives") should be 1 in 128 of
+//   occupied slots compared; more than that means the low hash bits are poorly distributed.
+//   Probes are counted in groups. Never resizes either.
+// - RobinHoodTable: linear probing where an insert takes over the slot of any key that is closer
+//   to its home slot than the key being inserted is ("robs the rich"), and that one moves on.
+//   Keeps probe lengths even, so the tail is short; lookups of missing keys stop as soon as they
+//   meet a key closer to its home than they are. Each slot stores its key's distance from home,
+//   so the probe length distribution of all stored keys can be had without doing any lookups.
+// - CuckooTable: bucketized cuckoo hashing, 4 slots per bucket, from a 128 bit hash: each 64 bit half
+//   picks one of the two buckets a key can be in. Lookups look at (at most) those two buckets. An
+//   insert into two full buckets kicks a random key out into its other bucket, and so on, until a
+//   free slot is found ("kick chain"); if that takes too long, the table counts as full. Slots store
+//   both hash halves, so moving a key does not need the key itself.
+// - CuckooFilter: approximate set membership with the same layout, but slots store only a 16 bit
+//   fingerprint (from the high hash half), and the second bucket comes from the first bucket and the
+//   fingerprint ("partial key cuckoo hashing", Fan et al. 2014). Can give false positives, never
+//   false negatives.
+// Both keep one "victim" entry that did not find a place when they got full, so nothing that was
+// inserted is lost.
+// - BlockedBloomFilter: Bloom filter where all k bits of a key are in one 512 bit block (a cache
+//   line), so a query touches one cache line (Putze et al. 2007). The caller says which block and
+//   which bits in it (BloomQuery): from k separate hashes, or from double hashing of one hash,
+//   g(i) = a + i*b (Kirsch & Mitzenmacher 2006). ContainsBatch prefetches the blocks of a whole
+//   batch of queries before testing any, so their cache misses overlap.
+//
+// ProbeHistogram collects probe lengths, for mean / percentiles / max.
+
+#include <vector>
+#include <stdint.h>
+#include <stddef.h>
+#include <math.h>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#	define HASH_TABLES_SSE2 1
+#	include <emmintrin.h>
+#endif
+#if defined(_MSC_VER)
+#	include <intrin.h>
+#endif
+
+#if HASH_TABLES_SSE2
+#	define HASH_TABLES_PREFETCH(p) _mm_prefetch((const char*)(p), _MM_HINT_T0)
+#elif defined(__GNUC__)
+#	define HASH_TABLES_PREFETCH(p) __builtin_prefetch(p)
+#else
+#	define HASH_TABLES_PREFETCH(p)
+#endif
+
+
+template<typename HashType>
+class LinearProbingTable
+{
+public:
+	enum { kEmpty = 0xFFFFFFFFu }; // index of an unused slot; also "not found"
+
+	LinearProbingTable() : m_Mask(0), m_Size(0) { }
+
+	// Clears the table; capacity is rounded up to a power of two
+	void Reset(size_t capacity)
+	{
+		size_t cap = 1;
+		while (cap < capacity)
+			cap *= 2;
+		Slot empty = { 0, kEmpty };
+		m_Slots.assign(cap, empty);
+		m_Mask = cap - 1;
+		m_Size = 0;
+	}
+
+	size_t GetCapacity() const { return m_Slots.size(); }
+	size_t GetSize() const { return m_Size; }
+	double GetLoadFactor() const { return m_Slots.empty() ? 0.0 : double(m_Size) / m_Slots.size(); }
+
+	// Inserts key index unless an equal key is in already; returns index of the key that is in the table
+	template<typename KeyEqual>
+	uint32_t Insert(HashType h, uint32_t index, const KeyEqual& equal, size_t& outProbes)
+	{
+		size_t pos = (size_t)h & m_Mask;
+		size_t probes = 1;
+		for (;; pos = (pos + 1) & m_Mask, ++probes)
+		{
+			Slot& s = m_Slots[pos];
+			if (s.index == kEmpty)
+			{
+				s.hash = h;
+				s.index = index;
+				++m_Size;
+				break;
+			}
+			if (s.hash == h && equal(s.index))
+			{
+				index = s.index;
+				break;
+			}
+		}
+		outProbes = probes;
+		return index;
+	}
+
+	// Index of the key, or kEmpty if it is not in the table
+	template<typename KeyEqual>
+	uint32_t Find(HashType h, const KeyEqual& equal, size_t& outProbes) const
+	{
+		size_t pos = (size_t)h & m_Mask;
+		size_t probes = 1;
+		uint32_t index;
+		for (;; pos = (pos + 1) & m_Mask, ++probes)
+		{
+			const Slot& s = m_Slots[pos];
+			index = s.index;
+			if (index == kEmpty || (s.hash == h && equal(index)))
+				break;
+		}
+		outProbes = probes;
+		return index;
+	}
+
+private:
+	struct Slot
+	{
+		HashType hash;
+		uint32_t index;
+	};
+	std::vector<Slot> m_Slots;
+	size_t m_Mask;
+	size_t m_Size;
+};
+
+
+struct SwissTableStats
+{
+	SwissTableStats() : groups(0), fullSlots(0), falseMatches(0) { }
+	size_t groups; // groups probed
+	size_t fullSlots; // occupied slots whose tags were compared
+	size_t falseMatches; // tag matched, but it was another key
+};
+
+template<typename HashType>
+class SwissTable
+{
+public:
+	enum { kEmpty = 0xFFFFFFFFu }; // "not found"
+	enum { kGroupSize = 16, kEmptyControl = 0x80 };
+
+	SwissTable() : m_GroupMask(0), m_Size(0) { }
+
+	// Clears the table; capacity is rounded up to a power of two number of groups
+	void Reset(size_t capacity)
+	{
+		size_t groups = 1;
+		while (groups * kGroupSize < capacity)
+			groups *= 2;
+		m_Control.assign(groups * kGroupSize, (uint8_t)kEmptyControl);
+		m_Slots.resize(groups * kGroupSize);
+		m_GroupMask = groups - 1;
+		m_Size = 0;
+	}
+
+	size_t GetCapacity() const { return m_Control.size(); }
+	size_t GetSize() const { return m_Size; }
+	double GetLoadFactor() const { return m_Control.empty() ? 0.0 : double(m_Size) / m_Control.size(); }
+
+	// Inserts key index unless an equal key is in already; returns index of the key that is in the table
+	template<typename KeyEqual>
+	uint32_t Insert(HashType h, uint32_t index, const KeyEqual& equal, SwissTableStats& stats)
+	{
+		size_t slot = 0;
+		uint32_t found = Probe(h, equal, stats, slot);
+		if (found != kEmpty)
+			return found;
+		m_Control[slot] = (uint8_t)(h & 0x7F);
+		m_Slots[slot].hash = h;
+		m_Slots[slot].index = index;
+		++m_Size;
+		return index;
+	}
+
+	// Index of the key, or kEmpty if it is not in the table
+	template<typename KeyEqual>
+	uint32_t Find(HashType h, const KeyEqual& equal, SwissTableStats& stats) const
+	{
+		size_t slot = 0;
+		return Probe(h, equal, stats, slot);
+	}
+
+private:
+	// 16 bit masks of control bytes in a group that are equal to value
+	static uint32_t MatchGroup(const uint8_t* control, uint8_t value)
+	{
+#		if HASH_TABLES_SSE2
+		__m128i ctrl = _mm_loadu_si128((const __m128i*)control);
+		return (uint32_t)_mm_movemask_epi8(_mm_cmpeq_epi8(ctrl, _mm_set1_epi8((char)value)));
+#		else
+		uint32_t mask = 0;
+		for (int i = 0; i < kGroupSize; ++i)
+			mask |= uint32_t(control[i] == value) << i;
+		return mask;
+#		endif
+	}
+	// v must not be zero
+	static int CountTrailingZeros(uint32_t v)
+	{
+#		if defined(__GNUC__)
+		return __builtin_ctz(v);
+#		elif defined(_MSC_VER)
+		unsigned long index;
+		_BitScanForward(&index, v);
+		return (int)index;
+#		else
+		int n = 0;
+		for (; !(v & 1); v >>= 1)
+			++n;
+		return n;
+#		endif
+	}
+	static int CountBits(uint32_t v)
+	{
+#		if defined(__GNUC__)
+		return __builtin_popcount(v);
+#		else
+		int n = 0;
+		for (; v; v &= v - 1)
+			++n;
+		return n;
+#		endif
+	}
+
+	// Index of the key if found; otherwise kEmpty, and the slot where it would be inserted
+	template<typename KeyEqual>
+	uint32_t Probe(HashType h, const KeyEqual& equal, SwissTableStats& stats, size_t& outSlot) const
+	{
+		const uint8_t tag = (uint8_t)(h & 0x7F);
+		size_t group = (size_t)(h >> 7) & m_GroupMask;
+		for (size_t step = 1; ; group = (group + step++) & m_GroupMask)
+		{
+			const uint8_t* control = &m_Control[group * kGroupSize];
+			const uint32_t empty = MatchGroup(control, (uint8_t)kEmptyControl);
+			const uint32_t match = MatchGroup(control, tag);
+			++stats.groups;
+			stats.fullSlots += kGroupSize - CountBits(empty);
+			stats.falseMatches += CountBits(match);
+			for (uint32_t m = match; m; m &= m - 1)
+			{
+				const Slot& s = m_Slots[group * kGroupSize + CountTrailingZeros(m)];
+				if (s.hash == h && equal(s.index))
+				{
+					// the key's own slot & tag match are not false positives
+					--stats.fullSlots;
+					--stats.falseMatches;
+					return s.index;
+				}
+			}
+			if (empty)
+			{
+				outSlot = group * kGroupSize + CountTrailingZeros(empty);
+				return kEmpty;
+			}
+		}
+	}
+
+	struct Slot
+	{
+		HashType hash;
+		uint32_t index;
+	};
+	std::vector<uint8_t> m_Control;
+	std::vector<Slot> m_Slots;
+	size_t m_GroupMask;
+	size_t m_Size;
+};
+
+
+struct ProbeHistogram
+{
+	ProbeHistogram() : total(0), sum(0) { }
+	std::vector<size_t> counts; // [probe length] = how many times
+	size_t total;
+	size_t sum;
+
+	void Add(size_t probes)
+	{
+		if (probes >= counts.size())
+			counts.resize(probes + 1);
+		++counts[probes];
+		++total;
+		sum += probes;
+	}
+	double GetMean() const { return total ? double(sum) / total : 0.0; }
+	size_t GetMax() const { return counts.empty() ? 0 : counts.size() - 1; }
+	// smallest probe length that p (0..1) of all counted ones are at or under
+	size_t GetPercentile(double p) const
+	{
+		size_t cumulative = 0;
+		for (size_t i = 0; i < counts.size(); ++i)
+		{
+			cumulative += counts[i];
+			if (cumulative >= p * total)
+				return i;
+		}
+		return GetMax();
+	}
+};
+
+template<typename HashType>
+class RobinHoodTable
+{
+public:
+	enum { kEmpty = 0xFFFFFFFFu }; // index of an unused slot; also "not found"
+
+	RobinHoodTable() : m_Mask(0), m_Size(0) { }
+
+	// Clears the table; capacity is rounded up to a power of two
+	void Reset(size_t capacity)
+	{
+		size_t cap = 1;
+		while (cap < capacity)
+			cap *= 2;
+		Slot empty = { 0, kEmpty, 0 };
+		m_Slots.assign(cap, empty);
+		m_Mask = cap - 1;
+		m_Size = 0;
+	}
+
+	size_t GetCapacity() const { return m_Slots.size(); }
+	size_t GetSize() const { return m_Size; }
+	double GetLoadFactor() const { return m_Slots.empty() ? 0.0 : double(m_Size) / m_Slots.size(); }
+
+	// Inserts key index unless an equal key is in already; returns index of the key that is in the table.
+	// outProbes is the slots looked at, including ones that displaced keys were moved through.
+	template<typename KeyEqual>
+	uint32_t Insert(HashType h, uint32_t index, const KeyEqual& equal, size_t& outProbes)
+	{
+		size_t pos = (size_t)h & m_Mask;
+		uint32_t dist = 0;
+		size_t probes = 1;
+		// an equal key can only be before the first slot that is empty or closer to its home
+		for (;; pos = (pos + 1) & m_Mask, ++dist, ++probes)
+		{
+			const Slot& s = m_Slots[pos];
+			if (s.index == kEmpty || s.dist < dist)
+				break;
+			if (s.hash == h && equal(s.index))
+			{
+				outProbes = probes;
+				return s.index;
+			}
+		}
+		Slot cur = { h, index, dist };
+		for (;; pos = (pos + 1) & m_Mask, ++cur.dist, ++probes)
+		{
+			Slot& s = m_Slots[pos];
+			if (s.index == kEmpty)
+			{
+				s = cur;
+				break;
+			}
+			if (s.dist < cur.dist)
+			{
+				Slot displaced = s;
+				s = cur;
+				cur = displaced;
+			}
+		}
+		++m_Size;
+		outProbes = probes;
+		return index;
+	}
+
+	// Index of the key, or kEmpty if it is not in the table
+	template<typename KeyEqual>
+	uint32_t Find(HashType h, const KeyEqual& equal, size_t& outProbes) const
+	{
+		size_t pos = (size_t)h & m_Mask;
+		for (uint32_t dist = 0; ; pos = (pos + 1) & m_Mask, ++dist)
+		{
+			const Slot& s = m_Slots[pos];
+			if (s.index == kEmpty || s.dist < dist)
+			{
+				outProbes = dist + 1;
+				return kEmpty;
+			}
+			if (s.hash == h && equal(s.index))
+			{
+				outProbes = dist + 1;
+				return s.index;
+			}
+		}
+	}
+
+	// Probe lengths that lookups of every stored key would take
+	void GetProbeHistogram(ProbeHistogram& out) const
+	{
+		for (size_t i = 0; i < m_Slots.size(); ++i)
+		{
+			if (m_Slots[i].index != kEmpty)
+				out.Add(m_Slots[i].dist + 1);
+		}
+	}
+
+private:
+	struct Slot
+	{
+		HashType hash;
+		uint32_t index;
+		uint32_t dist; // from the key's home slot
+	};
+	std::vector<Slot> m_Slots;
+	size_t m_Mask;
+	size_t m_Size;
+};
+
+
+const int kCuckooBucketSlots = 4;
+const int kCuckooMaxKicks = 500;
+
+// small xorshift generator for picking kick victims
+struct CuckooRandom
+{
+	CuckooRandom() : state(0x2545F4914F6CDD1DULL) { }
+	uint32_t Next(uint32_t range)
+	{
+		state ^= state << 13;
+		state ^= state >> 7;
+		state ^= state << 17;
+		return (uint32_t)((state >> 32) % range);
+	}
+	uint64_t state;
+};
+
+class CuckooTable
+{
+public:
+	enum { kEmpty = 0xFFFFFFFFu }; // index of an unused slot; also "not found"
+
+	CuckooTable() : m_Mask(0), m_Size(0), m_Full(false) { }
+
+	// Clears the table; capacity (in slots) is rounded up to a power of two number of buckets
+	void Reset(size_t capacity)
+	{
+		size_t buckets = 1;
+		while (buckets * kCuckooBucketSlots < capacity)
+			buckets *= 2;
+		Slot empty = { 0, 0, kEmpty };
+		m_Slots.assign(buckets * kCuckooBucketSlots, empty);
+		m_Victim = empty;
+		m_Mask = buckets - 1;
+		m_Size = 0;
+		m_Full = false;
+		m_Random = CuckooRandom();
+	}
+
+	size_t GetCapacity() const { return m_Slots.size(); }
+	size_t GetSize() const { return m_Size; } // not counting the victim
+	double GetLoadFactor() const { return m_Slots.empty() ? 0.0 : double(m_Size) / m_Slots.size(); }
+	bool IsFull() const { return m_Full; }
+
+	// Inserts key index unless an equal key is in already. Returns false if the table is (or just
+	// became) full; in the latter case, the key that did not find a place is kept as the victim.
+	// outKicks is how many keys had to be moved.
+	template<typename KeyEqual>
+	bool Insert(uint64_t h1, uint64_t h2, uint32_t index, const KeyEqual& equal, size_t& outKicks)
+	{
+		outKicks = 0;
+		if (Find(h1, h2, equal) != kEmpty)
+			return true;
+		if (m_Full)
+			return false;
+		Slot cur = { h1, h2, index };
+		size_t bucket = h1 & m_Mask;
+		if (PlaceInBucket(bucket, cur) || PlaceInBucket(h2 & m_Mask, cur))
+			return true;
+		if (m_Random.Next(2))
+			bucket = h2 & m_Mask;
+		for (int kick = 0; kick < kCuckooMaxKicks; ++kick)
+		{
+			Slot& victim = m_Slots[bucket * kCuckooBucketSlots + m_Random.Next(kCuckooBucketSlots)];
+			Slot moved = victim;
+			victim = cur;
+			cur = moved;
+			++outKicks;
+			bucket = (cur.h1 & m_Mask) == bucket ? (cur.h2 & m_Mask) : (cur.h1 & m_Mask);
+			if (PlaceInBucket(bucket, cur))
+				return true;
+		}
+		m_Victim = cur;
+		m_Full = true;
+		return false;
+	}
+
+	// Index of the key, or kEmpty if it is not in the table
+	template<typename KeyEqual>
+	uint32_t Find(uint64_t h1, uint64_t h2, const KeyEqual& equal) const
+	{
+		const Slot* b1 = &m_Slots[(h1 & m_Mask) * kCuckooBucketSlots];
+		const Slot* b2 = &m_Slots[(h2 & m_Mask) * kCuckooBucketSlots];
+		for (int i = 0; i < kCuckooBucketSlots; ++i)
+		{
+			if (b1[i].h1 == h1 && b1[i].h2 == h2 && b1[i].index != kEmpty && equal(b1[i].index))
+				return b1[i].index;
+			if (b2[i].h1 == h1 && b2[i].h2 == h2 && b2[i].index != kEmpty && equal(b2[i].index))
+				return b2[i].index;
+		}
+		if (m_Victim.index != kEmpty && m_Victim.h1 == h1 && m_Victim.h2 == h2 && equal(m_Victim.index))
+			return m_Victim.index;
+		return kEmpty;
+	}
+
+private:
+	struct Slot
+	{
+		uint64_t h1, h2;
+		uint32_t index;
+	};
+
+	bool PlaceInBucket(size_t bucket, const Slot& slot)
+	{
+		Slot* b = &m_Slots[bucket * kCuckooBucketSlots];
+		for (int i = 0; i < kCuckooBucketSlots; ++i)
+		{
+			if (b[i].index == kEmpty)
+			{
+				b[i] = slot;
+				++m_Size;
+				return true;
+			}
+		}
+		return false;
+	}
+
+	std::vector<Slot> m_Slots;
+	Slot m_Victim;
+	size_t m_Mask;
+	size_t m_Size;
+	bool m_Full;
+	CuckooRandom m_Random;
+};
+
+class CuckooFilter
+{
+public:
+	enum { kFingerprintBits = 16 };
+
+	CuckooFilter() : m_Mask(0), m_Size(0), m_Full(false), m_VictimBucket(0), m_VictimFingerprint(0) { }
+
+	// Clears the filter; capacity (in fingerprints) is rounded up to a power of two number of buckets
+	void Reset(size_t capacity)
+	{
+		size_t buckets = 1;
+		while (buckets * kCuckooBucketSlots < capacity)
+			buckets *= 2;
+		m_Fingerprints.assign(buckets * kCuckooBucketSlots, 0);
+		m_Mask = buckets - 1;
+		m_Size = 0;
+		m_Full = false;
+		m_VictimBucket = 0;
+		m_VictimFingerprint = 0;
+		m_Random = CuckooRandom();
+	}
+
+	size_t GetCapacity() const { return m_Fingerprints.size(); }
+	size_t GetSize() const { return m_Size; }
+	double GetLoadFactor() const { return m_Fingerprints.empty() ? 0.0 : double(m_Size) / m_Fingerprints.size(); }
+	bool IsFull() const { return m_Full; }
+
+	// False positive rate the filter should have at its current load: chance that one of the
+	// fingerprints in two buckets matches
+	double GetExpectedFalsePositiveRate() const
+	{
+		return 1.0 - pow(1.0 - 1.0 / (1 << kFingerprintBits), 2.0 * kCuckooBucketSlots * GetLoadFactor());
+	}
+
+	// Adds the key unless it (or something with the same fingerprint & buckets) is in already.
+	// Returns false if the filter is (or just became) full; outKicks is how many fingerprints had to be moved.
+	bool Insert(uint64_t h1, uint64_t h2, size_t& outKicks)
+	{
+		outKicks = 0;
+		if (Contains(h1, h2))
+			return true;
+		if (m_Full)
+			return false;
+		uint16_t fingerprint = GetFingerprint(h2);
+		size_t bucket = h1 & m_Mask;
+		const size_t bucket2 = GetAltBucket(bucket, fingerprint);
+		if (PlaceInBucket(bucket, fingerprint) || PlaceInBucket(bucket2, fingerprint))
+			return true;
+		if (m_Random.Next(2))
+			bucket = bucket2;
+		for (int kick = 0; kick < kCuckooMaxKicks; ++kick)
+		{
+			uint16_t& victim = m_Fingerprints[bucket * kCuckooBucketSlots + m_Random.Next(kCuckooBucketSlots)];
+			uint16_t moved = victim;
+			victim = fingerprint;
+			fingerprint = moved;
+			++outKicks;
+			bucket = GetAltBucket(bucket, fingerprint);
+			if (PlaceInBucket(bucket, fingerprint))
+				return true;
+		}
+		m_VictimBucket = bucket;
+		m_VictimFingerprint = fingerprint;
+		m_Full = true;
+		return false;
+	}
+
+	bool Contains(uint64_t h1, uint64_t h2) const
+	{
+		const uint16_t fingerprint = GetFingerprint(h2);
+		const size_t bucket1 = h1 & m_Mask;
+		const size_t bucket2 = GetAltBucket(bucket1, fingerprint);
+		const uint16_t* b1 = &m_Fingerprints[bucket1 * kCuckooBucketSlots];
+		const uint16_t* b2 = &m_Fingerprints[bucket2 * kCuckooBucketSlots];
+		bool found = false;
+		for (int i = 0; i < kCuckooBucketSlots; ++i)
+			found |= (b1[i] == fingerprint) | (b2[i] == fingerprint);
+		if (m_VictimFingerprint == fingerprint && (m_VictimBucket == bucket1 || m_VictimBucket == bucket2))
+			found = true;
+		return found;
+	}
+
+private:
+	// 0 means an empty slot
+	static uint16_t GetFingerprint(uint64_t h2)
+	{
+		uint16_t f = (uint16_t)h2;
+		return f ? f : 1;
+	}
+	// symmetric: the alternative of the alternative is the original bucket
+	size_t GetAltBucket(size_t bucket, uint16_t fingerprint) const
+	{
+		return (bucket ^ (fingerprint * 0x5bd1e995u)) & m_Mask;
+	}
+	bool PlaceInBucket(size_t bucket, uint16_t fingerprint)
+	{
+		uint16_t* b = &m_Fingerprints[bucket * kCuckooBucketSlots];
+		for (int i = 0; i < kCuckooBucketSlots; ++i)
+		{
+			if (b[i] == 0)
+			{
+				b[i] = fingerprint;
+				++m_Size;
+				return true;
+			}
+		}
+		return false;
+	}
+
+	std::vector<uint16_t> m_Fingerprints;
+	size_t m_Mask;
+	size_t m_Size;
+	bool m_Full;
+	size_t m_VictimBucket; // when full: the fingerprint that did not fit, and one of its buckets
+	uint16_t m_VictimFingerprint;
+	CuckooRandom m_Random;
+};
+
+
+// Where one key goes in a BlockedBloomFilter
+struct BloomQuery
+{
+	enum { kMaxProbes = 16 };
+	uint32_t blockHash; // block is picked from its high bits
+	uint16_t bits[kMaxProbes]; // 0..511 within the block
+};
+
+class BlockedBloomFilter
+{
+public:
+	enum { kBlockBits = 512, kBlockWords = kBlockBits / 64, kBlockBytes = kBlockBits / 8 };
+
+	BlockedBloomFilter() : m_Blocks(NULL), m_BlockCount(0), m_ProbeCount(0) { }
+
+	// Clears the filter; size is rounded up to whole blocks, which need not be a power of two.
+	// probeCount is k, at most BloomQuery::kMaxProbes.
+	void Reset(size_t bitCount, int probeCount)
+	{
+		m_BlockCount = (bitCount + kBlockBits - 1) / kBlockBits;
+		if (m_BlockCount == 0)
+			m_BlockCount = 1;
+		m_ProbeCount = probeCount;
+		// one extra block, so that blocks can start on a cache line
+		m_Storage.assign((m_BlockCount + 1) * kBlockWords, 0);
+		m_Blocks = &m_Storage[0];
+		while (((uintptr_t)m_Blocks) % kBlockBytes)
+			++m_Blocks;
+	}
+
+	size_t GetBitCount() const { return m_BlockCount * kBlockBits; }
+	int GetProbeCount() const { return m_ProbeCount; }
+
+	// False positive rate after inserting keyCount keys. Keys per block follow a Poisson distribution,
+	// and fuller blocks give more false positives than the plain Bloom filter formula (1-e^(-kn/m))^k
+	// says; that is what blocking costs.
+	double GetExpectedFalsePositiveRate(size_t keyCount) const
+	{
+		const double keysPerBlock = double(keyCount) / m_BlockCount;
+		const int maxKeys = (int)(keysPerBlock + 10 * sqrt(keysPerBlock) + 20);
+		double poisson = exp(-keysPerBlock); // chance of a block having j keys
+		double res = 0;
+		for (int j = 0; j <= maxKeys; ++j)
+		{
+			if (j > 0)
+				poisson *= keysPerBlock / j;
+			const double bitSet = 1.0 - pow(1.0 - 1.0 / kBlockBits, (double)j * m_ProbeCount);
+			res += poisson * pow(bitSet, (double)m_ProbeCount);
+		}
+		return res;
+	}
+
+	// Kirsch-Mitzenmacher double hashing: bit i is the top 9 bits of a + i*b; b is made odd, so
+	// that the probes only repeat after all 2^32 steps
+	void GetDoubleHashQuery(uint32_t blockHash, uint32_t a, uint32_t b, BloomQuery& out) const
+	{
+		out.blockHash = blockHash;
+		b |= 1;
+		for (int i = 0; i < m_ProbeCount; ++i, a += b)
+			out.bits[i] = (uint16_t)(a >> 23);
+	}
+
+	void Insert(const BloomQuery& query)
+	{
+		uint64_t* block = GetBlock(query.blockHash);
+		for (int i = 0; i < m_ProbeCount; ++i)
+			block[query.bits[i] >> 6] |= 1ull << (query.bits[i] & 63);
+	}
+
+	bool Contains(const BloomQuery& query) const
+	{
+		const uint64_t* block = GetBlock(query.blockHash);
+		uint64_t mask[kBlockWords] = { 0 };
+		for (int i = 0; i < m_ProbeCount; ++i)
+			mask[query.bits[i] >> 6] |= 1ull << (query.bits[i] & 63);
+		uint64_t missing = 0;
+		for (int i = 0; i < kBlockWords; ++i)
+			missing |= mask[i] & ~block[i];
+		return missing == 0;
+	}
+
+	// Prefetches the blocks of all queries, then tests them; returns how many were found
+	size_t ContainsBatch(const BloomQuery* queries, size_t count, bool* outFound) const
+	{
+		for (size_t i = 0; i < count; ++i)
+			HASH_TABLES_PREFETCH(GetBlock(queries[i].blockHash));
+		size_t found = 0;
+		for (size_t i = 0; i < count; ++i)
+		{
+			outFound[i] = Contains(queries[i]);
+			found += outFound[i];
+		}
+		return found;
+	}
+
+private:
+	// fastrange: high bits of the block hash pick the block
+	uint64_t* GetBlock(uint32_t blockHash) const
+	{
+		return m_Blocks + (size_t)(((uint64_t)blockHash * m_BlockCount) >> 32) * kBlockWords;
+	}
+
+	std::vector<uint64_t> m_Storage;
+	uint64_t* m_Blocks; // cache line aligned, inside m_Storage
+	size_t m_BlockCount;
+	int m_ProbeCount;
+};
@@ -0,0 +1,105 @@
+#pragma once
+
+// Finding newline positions in large text buffers, 16 (SSE2) or 32 (AVX2) bytes at a time.
+// FindNewlines appends offsets of all '\n' characters in [begin,end) of data to outPositions,
+// in increasing order. Picks the widest SIMD variant the CPU supports at runtime.
+
+#include <vector>
+#include <stddef.h>
+#include <stdint.h>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#	define LINE_SPLITTER_SSE2 1
+#	include <emmintrin.h>
+#endif
+#if LINE_SPLITTER_SSE2 && (defined(__GNUC__) || defined(__clang__)) && (defined(__x86_64__) || defined(__i386__))
+#	define LINE_SPLITTER_AVX2 1
+#	include <immintrin.h>
+#endif
+#if defined(_MSC_VER)
+#	include <intrin.h>
+#endif
+
+
+inline int LineSplitterCountTrailingZeros(uint32_t v)
+{
+#	if defined(_MSC_VER)
+	unsigned long index;
+	_BitScanForward(&index, v);
+	return (int)index;
+#	else
+	return __builtin_ctz(v);
+#	endif
+}
+
+static void FindNewlinesScalar(const char* data, size_t begin, size_t end, std::vector<size_t>& outPositions)
+{
+	for (size_t pos = begin; pos < end; ++pos)
+	{
+		if (data[pos] == '\n')
+			outPositions.push_back(pos);
+	}
+}
+
+#if LINE_SPLITTER_SSE2
+static void FindNewlinesSSE2(const char* data, size_t begin, size_t end, std::vector<size_t>& outPositions)
+{
+	const __m128i newline = _mm_set1_epi8('\n');
+	size_t pos = begin;
+	for (; pos + 16 <= end; pos += 16)
+	{
+		__m128i chunk = _mm_loadu_si128((const __m128i*)(data + pos));
+		uint32_t mask = (uint32_t)_mm_movemask_epi8(_mm_cmpeq_epi8(chunk, newline));
+		while (mask)
+		{
+			outPositions.push_back(pos + LineSplitterCountTrailingZeros(mask));
+			mask &= mask - 1;
+		}
+	}
+	FindNewlinesScalar(data, pos, end, outPositions);
+}
+#endif
+
+#if LINE_SPLITTER_AVX2
+__attribute__((target("avx2")))
+static void FindNewlinesAVX2(const char* data, size_t begin, size_t end, std::vector<size_t>& outPositions)
+{
+	const __m256i newline = _mm256_set1_epi8('\n');
+	size_t pos = begin;
+	for (; pos + 32 <= end; pos += 32)
+	{
+		__m256i chunk = _mm256_loadu_si256((const __m256i*)(data + pos));
+		uint32_t mask = (uint32_t)_mm256_movemask_epi8(_mm256_cmpeq_epi8(chunk, newline));
+		while (mask)
+		{
+			outPositions.push_back(pos + LineSplitterCountTrailingZeros(mask));
+			mask &= mask - 1;
+		}
+	}
+	FindNewlinesScalar(data, pos, end, outPositions);
+}
+
+static bool LineSplitterDetectAVX2()
+{
+	__builtin_cpu_init();
+	return __builtin_cpu_supports("avx2") != 0;
+}
+#endif
+
+// Called from several loader threads at once
+static void FindNewlines(const char* data, size_t begin, size_t end, std::vector<size_t>& outPositions)
+{
+#	if LINE_SPLITTER_AVX2
+	static const bool avx2Support = LineSplitterDetectAVX2(); // thread safe static initialization
+	if (avx2Support)
+	{
+		FindNewlinesAVX2(data, begin, end, outPositions);
+		return;
+	}
+#	endif
+#	if LINE_SPLITTER_SSE2
+	FindNewlinesSSE2(data, begin, end, outPositions);
+#	else
+	FindNewlinesScalar(data, begin, end, outPositions);
+#	endif
+}
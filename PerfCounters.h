@@ -0,0 +1,203 @@
+#pragma once
+
+// Hardware performance counters around a piece of code, through the Linux perf_event_open
+// syscall (no external tools needed). All counters are opened as one group, so they are
+// scheduled onto the PMU together and count exactly the same interval. Only user space
+// is counted, so that works with the default kernel.perf_event_paranoid setting of 2.
+//
+// Counters that the CPU / kernel / VM does not support are simply left out; if the
+// cycle counter itself can't be opened, the group is not usable at all. Elsewhere than
+// Linux, Open() always fails.
+
+#include "PlatformWrap.h"
+
+#include <string>
+#include <string.h>
+#include <stdint.h>
+
+#if PLATFORM_LINUX
+#	define PERF_COUNTERS 1
+#	include <linux/perf_event.h>
+#	include <sys/syscall.h>
+#	include <sys/ioctl.h>
+#	include <unistd.h>
+#	if defined(__x86_64__) || defined(__i386__)
+#		include <cpuid.h>
+#	endif
+#endif
+
+enum PerfCounterType
+{
+	kPerfCounterCycles,
+	kPerfCounterInstructions,
+	kPerfCounterBranches,
+	kPerfCounterBranchMisses,
+	kPerfCounterL1DMisses,
+	kPerfCounterUops,
+	kPerfCounterCount
+};
+
+static const char* kPerfCounterNames[kPerfCounterCount] = { "cycles", "instructions", "branches", "branchMisses", "l1dMisses", "uops" };
+
+struct PerfCounterValues
+{
+	PerfCounterValues() { for (int i = 0; i < kPerfCounterCount; ++i) values[i] = -1; }
+	bool Has(int type) const { return values[type] >= 0; }
+	double values[kPerfCounterCount]; // negative when the counter is not available
+};
+
+
+class PerfCounterGroup
+{
+public:
+	PerfCounterGroup() : m_OpenCount(0) { for (int i = 0; i < kPerfCounterCount; ++i) m_Fds[i] = -1; }
+	~PerfCounterGroup() { Close(); }
+
+	bool IsOpen() const { return m_Fds[kPerfCounterCycles] >= 0; }
+
+	bool Open()
+	{
+		Close();
+#		if PERF_COUNTERS
+		if (!OpenCounter(kPerfCounterCycles, PERF_TYPE_HARDWARE, PERF_COUNT_HW_CPU_CYCLES))
+			return false;
+		OpenCounter(kPerfCounterInstructions, PERF_TYPE_HARDWARE, PERF_COUNT_HW_INSTRUCTIONS);
+		OpenCounter(kPerfCounterBranches, PERF_TYPE_HARDWARE, PERF_COUNT_HW_BRANCH_INSTRUCTIONS);
+		OpenCounter(kPerfCounterBranchMisses, PERF_TYPE_HARDWARE, PERF_COUNT_HW_BRANCH_MISSES);
+		OpenCounter(kPerfCounterL1DMisses, PERF_TYPE_HW_CACHE,
+			PERF_COUNT_HW_CACHE_L1D | (PERF_COUNT_HW_CACHE_OP_READ << 8) | (PERF_COUNT_HW_CACHE_RESULT_MISS << 16));
+		uint64_t uopsEvent = GetUopsRetiredEvent();
+		if (uopsEvent)
+			OpenCounter(kPerfCounterUops, PERF_TYPE_RAW, uopsEvent);
+		return true;
+#		else
+		return false;
+#		endif
+	}
+
+	void Close()
+	{
+#		if PERF_COUNTERS
+		// group members first, leader last
+		for (int i = kPerfCounterCount - 1; i >= 0; --i)
+		{
+			if (m_Fds[i] >= 0)
+				close(m_Fds[i]);
+			m_Fds[i] = -1;
+		}
+#		endif
+		m_OpenCount = 0;
+	}
+
+	// space separated names of the counters that could be opened
+	std::string GetAvailableNames() const
+	{
+		std::string res;
+		for (int i = 0; i < kPerfCounterCount; ++i)
+		{
+			if (m_Fds[i] < 0)
+				continue;
+			if (!res.empty())
+				res += ' ';
+			res += kPerfCounterNames[i];
+		}
+		return res;
+	}
+
+	void Start()
+	{
+#		if PERF_COUNTERS
+		ioctl(m_Fds[kPerfCounterCycles], PERF_EVENT_IOC_RESET, PERF_IOC_FLAG_GROUP);
+		ioctl(m_Fds[kPerfCounterCycles], PERF_EVENT_IOC_ENABLE, PERF_IOC_FLAG_GROUP);
+#		endif
+	}
+
+	void Stop()
+	{
+#		if PERF_COUNTERS
+		ioctl(m_Fds[kPerfCounterCycles], PERF_EVENT_IOC_DISABLE, PERF_IOC_FLAG_GROUP);
+#		endif
+	}
+
+	// Counts since Start; scaled up if the kernel had to multiplex the group with others
+	bool Read(PerfCounterValues& out) const
+	{
+		out = PerfCounterValues();
+#		if PERF_COUNTERS
+		// PERF_FORMAT_GROUP layout: count, time enabled, time running, values in open order
+		uint64_t buf[3 + kPerfCounterCount];
+		ssize_t size = read(m_Fds[kPerfCounterCycles], buf, sizeof(buf));
+		if (size < (ssize_t)(3 * sizeof(uint64_t)) || buf[0] != (uint64_t)m_OpenCount || buf[2] == 0)
+			return false;
+		const double scale = double(buf[1]) / double(buf[2]);
+		for (int i = 0; i < m_OpenCount; ++i)
+			out.values[m_Order[i]] = buf[3 + i] * scale;
+		return true;
+#		else
+		return false;
+#		endif
+	}
+
+private:
+#	if PERF_COUNTERS
+	bool OpenCounter(PerfCounterType type, uint32_t eventType, uint64_t config)
+	{
+		perf_event_attr attr;
+		memset(&attr, 0, sizeof(attr));
+		attr.size = sizeof(attr);
+		attr.type = eventType;
+		attr.config = config;
+		attr.exclude_kernel = 1;
+		attr.exclude_hv = 1;
+		attr.read_format = PERF_FORMAT_GROUP | PERF_FORMAT_TOTAL_TIME_ENABLED | PERF_FORMAT_TOTAL_TIME_RUNNING;
+		const int leader = m_Fds[kPerfCounterCycles];
+		if (leader < 0)
+			attr.disabled = 1; // members follow the leader's enable state
+		int fd = (int)syscall(__NR_perf_event_open, &attr, 0 /*this thread*/, -1 /*any cpu*/, leader, 0);
+		if (fd < 0)
+			return false;
+		m_Fds[type] = fd;
+		m_Order[m_OpenCount++] = type;
+		return true;
+	}
+
+	// there's no generic "uops retired" event; raw event codes for the CPUs we know of, 0 if unknown
+	static uint64_t GetUopsRetiredEvent()
+	{
+#		if defined(__x86_64__) || defined(__i386__)
+		unsigned eax, ebx, ecx, edx;
+		if (!__get_cpuid(0, &eax, &ebx, &ecx, &edx))
+			return 0;
+		char vendor[13];
+		memcpy(vendor + 0, &ebx, 4);
+		memcpy(vendor + 4, &edx, 4);
+		memcpy(vendor + 8, &ecx, 4);
+		vendor[12] = 0;
+		__get_cpuid(1, &eax, &ebx, &ecx, &edx);
+		unsigned family = (eax >> 8) & 0xF;
+		unsigned model = (eax >> 4) & 0xF;
+		if (family == 0xF)
+			family += (eax >> 20) & 0xFF;
+		if (family == 0x6 || family == 0xF)
+			model += ((eax >> 16) & 0xF) << 4;
+		if (strcmp(vendor, "AuthenticAMD") == 0 && family >= 0x17)
+			return 0xC1; // Zen: Retired Ops
+		if (strcmp(vendor, "GenuineIntel") == 0 && family == 6)
+		{
+			// Ice Lake and later big cores: UOPS_RETIRED.SLOTS; before: UOPS_RETIRED.ALL
+			const unsigned kSlotsModels[] = { 0x6A, 0x6C, 0x7D, 0x7E, 0x8C, 0x8D, 0x8F, 0x97, 0x9A, 0xA7, 0xAA, 0xAC, 0xAD, 0xAE, 0xB7, 0xBA, 0xBF, 0xC5, 0xC6, 0xCF };
+			for (size_t i = 0; i < sizeof(kSlotsModels)/sizeof(kSlotsModels[0]); ++i)
+				if (model == kSlotsModels[i])
+					return 0x02C2;
+			return 0x01C2;
+		}
+#		endif
+		return 0;
+	}
+
+#	endif
+
+	int m_Fds[kPerfCounterCount];
+	PerfCounterType m_Order[kPerfCounterCount]; // order counters were opened in = order in group reads
+	int m_OpenCount;
+};
@@ -43,6 +43,10 @@
 #	define PLATFORM_ANDROID 1
 #endif
 
+#if defined(__linux__) && !defined(__ANDROID__) && !defined(EMSCRIPTEN)
+#	define PLATFORM_LINUX 1
+#endif
+
 // ------------------------------------------------------------------------------------
 // Misc
 
@@ -129,6 +133,78 @@
 		return std::chrono::duration<double, std::milli>(ttt1 - s_Time0).count() / 1000.0;
 	}		
 
+#elif PLATFORM_LINUX
+	// Wall time from CLOCK_MONOTONIC_RAW (not slewed by NTP), and on x86 also the
+	// time stamp counter, so that results can be expressed in cycles. Note that on
+	// any CPU from the last decade the TSC ticks at a constant reference rate, i.e.
+	// these are "nominal frequency" cycles, and not actual core clocks under turbo.
+	#include <stdint.h>
+	#include <time.h>
+	#if defined(__x86_64__) || defined(__i386__)
+	#	include <x86intrin.h>
+	#	define PLATFORM_HAS_CYCLE_COUNTER 1
+	#endif
+
+	static uint64_t TimerReadNanoseconds()
+	{
+		timespec ts;
+		clock_gettime(CLOCK_MONOTONIC_RAW, &ts);
+		return uint64_t(ts.tv_sec) * 1000000000ull + ts.tv_nsec;
+	}
+	#if PLATFORM_HAS_CYCLE_COUNTER
+	static uint64_t TimerReadCycles()
+	{
+		// rdtscp waits for all previous instructions to finish; lfence after it
+		// prevents following ones from starting before the counter is read.
+		unsigned aux;
+		uint64_t c = __rdtscp(&aux);
+		_mm_lfence();
+		return c;
+	}
+	static uint64_t s_Cycles0;
+	static uint64_t s_LastCycles;
+	#endif
+
+	static uint64_t s_Time0;
+	static void TimerBegin()
+	{
+		s_Time0 = TimerReadNanoseconds();
+	#if PLATFORM_HAS_CYCLE_COUNTER
+		s_Cycles0 = TimerReadCycles();
+	#endif
+	}
+	static float TimerEnd()
+	{
+	#if PLATFORM_HAS_CYCLE_COUNTER
+		s_LastCycles = TimerReadCycles() - s_Cycles0;
+	#endif
+		uint64_t ttt1 = TimerReadNanoseconds();
+		return float((ttt1 - s_Time0) * 1.0e-9);
+	}
+
+	#if PLATFORM_HAS_CYCLE_COUNTER
+	// Cycles elapsed between the last TimerBegin/TimerEnd pair.
+	static uint64_t TimerLastCycles()
+	{
+		return s_LastCycles;
+	}
+	// Counter frequency, calibrated once against the monotonic clock (~50ms busy wait).
+	static double TimerCyclesPerSecond()
+	{
+		static double cyclesPerSec = 0;
+		if (cyclesPerSec == 0)
+		{
+			uint64_t t0 = TimerReadNanoseconds();
+			uint64_t c0 = TimerReadCycles();
+			uint64_t t1;
+			do { t1 = TimerReadNanoseconds(); } while (t1 - t0 < 50000000);
+			uint64_t c1 = TimerReadCycles();
+			cyclesPerSec = double(c1 - c0) * 1.0e9 / double(t1 - t0);
+		}
+		return cyclesPerSec;
+	}
+	#endif
+
 #else
 	#error "Unknown platform, timer code missing"
 
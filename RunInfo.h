@@ -0,0 +1,185 @@
+#pragma once
+
+// Description of the machine & build that produced a set of results, so that structured
+// result files from different machines / builds can be told apart and compared.
+//
+// Build scripts can pass HASHTEST_COMPILE_FLAGS and HASHTEST_GIT_REVISION (as string
+// literals) on the compiler command line; compile.sh does.
+
+#include "PlatformWrap.h"
+
+#include <string>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+
+#if defined(__x86_64__) || defined(__i386__) || defined(_M_X64) || defined(_M_IX86)
+#	define RUN_INFO_X86 1
+#	if defined(_MSC_VER)
+#		include <intrin.h>
+#	else
+#		include <cpuid.h>
+#	endif
+#endif
+
+#ifndef HASHTEST_COMPILE_FLAGS
+#	define HASHTEST_COMPILE_FLAGS "unknown"
+#endif
+#ifndef HASHTEST_GIT_REVISION
+#	define HASHTEST_GIT_REVISION "unknown"
+#endif
+
+
+struct RunInfo
+{
+	std::string cpuModel;
+	std::string cpuFlags; // space separated, only the ones that matter for hash functions
+	std::string governor; // CPU frequency scaling governor, where known
+	std::string compiler;
+	std::string compileFlags;
+	std::string gitRevision;
+	std::string timestamp; // ISO 8601, UTC
+};
+
+
+#if RUN_INFO_X86
+static void RunInfoCpuid(unsigned leaf, unsigned subleaf, unsigned regs[4])
+{
+#	if defined(_MSC_VER)
+	__cpuidex((int*)regs, (int)leaf, (int)subleaf);
+#	else
+	__cpuid_count(leaf, subleaf, regs[0], regs[1], regs[2], regs[3]);
+#	endif
+}
+#endif
+
+#if PLATFORM_LINUX || PLATFORM_ANDROID
+// First line of a text file, without the trailing newline; empty if it can't be read
+static std::string RunInfoReadLine(const char* path)
+{
+	std::string res;
+	FILE* f = fopen(path, "rb");
+	if (!f)
+		return res;
+	char buf[256];
+	if (fgets(buf, sizeof(buf), f))
+	{
+		res = buf;
+		while (!res.empty() && (res[res.size()-1] == '\n' || res[res.size()-1] == '\r'))
+			res.erase(res.size()-1);
+	}
+	fclose(f);
+	return res;
+}
+#endif
+
+#if !RUN_INFO_X86 && (PLATFORM_LINUX || PLATFORM_ANDROID)
+// Value of the first "key : value" line in /proc/cpuinfo (non-x86 has no CPUID to ask)
+static std::string RunInfoReadCpuinfo(const char* key)
+{
+	std::string res;
+	FILE* f = fopen("/proc/cpuinfo", "rb");
+	if (!f)
+		return res;
+	char buf[4096];
+	const size_t keyLen = strlen(key);
+	while (fgets(buf, sizeof(buf), f))
+	{
+		if (strncmp(buf, key, keyLen) != 0 || (buf[keyLen] != ' ' && buf[keyLen] != '\t' && buf[keyLen] != ':'))
+			continue;
+		const char* colon = strchr(buf, ':');
+		if (!colon)
+			continue;
+		res = colon + 1;
+		while (!res.empty() && res[0] == ' ')
+			res.erase(0, 1);
+		while (!res.empty() && (res[res.size()-1] == '\n' || res[res.size()-1] == '\r'))
+			res.erase(res.size()-1);
+		break;
+	}
+	fclose(f);
+	return res;
+}
+#endif
+
+static void AppendFlag(std::string& flags, const char* flag)
+{
+	if (!flags.empty())
+		flags += ' ';
+	flags += flag;
+}
+
+static void GatherRunInfo(RunInfo& info)
+{
+	// CPU
+#	if RUN_INFO_X86
+	unsigned regs[4];
+	RunInfoCpuid(0x80000000, 0, regs);
+	if (regs[0] >= 0x80000004)
+	{
+		char brand[49];
+		for (unsigned i = 0; i < 3; ++i)
+		{
+			RunInfoCpuid(0x80000002 + i, 0, regs);
+			memcpy(brand + i * 16, regs, 16);
+		}
+		brand[48] = 0;
+		info.cpuModel = brand;
+		while (!info.cpuModel.empty() && info.cpuModel[0] == ' ')
+			info.cpuModel.erase(0, 1);
+	}
+	RunInfoCpuid(0, 0, regs);
+	const unsigned maxLeaf = regs[0];
+	RunInfoCpuid(1, 0, regs);
+	if (regs[3] & (1u << 26)) AppendFlag(info.cpuFlags, "sse2");
+	if (regs[2] & (1u << 20)) AppendFlag(info.cpuFlags, "sse4.2");
+	if (regs[2] & (1u << 25)) AppendFlag(info.cpuFlags, "aes");
+	if (regs[2] & (1u << 1)) AppendFlag(info.cpuFlags, "pclmul");
+	if (maxLeaf >= 7)
+	{
+		RunInfoCpuid(7, 0, regs);
+		if (regs[1] & (1u << 5)) AppendFlag(info.cpuFlags, "avx2");
+		if (regs[1] & (1u << 8)) AppendFlag(info.cpuFlags, "bmi2");
+		if (regs[1] & (1u << 16)) AppendFlag(info.cpuFlags, "avx512f");
+		if (regs[1] & (1u << 29)) AppendFlag(info.cpuFlags, "sha");
+	}
+#	elif PLATFORM_LINUX || PLATFORM_ANDROID
+	info.cpuModel = RunInfoReadCpuinfo("model name");
+	if (info.cpuModel.empty())
+		info.cpuModel = RunInfoReadCpuinfo("Hardware");
+	// ARM: pick interesting ones out of the "Features" line
+	std::string features = " " + RunInfoReadCpuinfo("Features") + " ";
+	const char* kArmFlags[] = { "neon", "asimd", "aes", "pmull", "sha1", "sha2", "crc32" };
+	for (size_t i = 0; i < sizeof(kArmFlags)/sizeof(kArmFlags[0]); ++i)
+	{
+		if (features.find(std::string(" ") + kArmFlags[i] + " ") != std::string::npos)
+			AppendFlag(info.cpuFlags, kArmFlags[i]);
+	}
+#	endif
+	if (info.cpuModel.empty())
+		info.cpuModel = "unknown";
+
+#	if PLATFORM_LINUX || PLATFORM_ANDROID
+	info.governor = RunInfoReadLine("/sys/devices/system/cpu/cpu0/cpufreq/scaling_governor");
+#	endif
+
+	// build
+	char buf[128];
+#	if defined(__clang__)
+	snprintf(buf, sizeof(buf), "clang %s", __clang_version__);
+#	elif defined(__GNUC__)
+	snprintf(buf, sizeof(buf), "gcc %s", __VERSION__);
+#	elif defined(_MSC_VER)
+	snprintf(buf, sizeof(buf), "msvc %i", _MSC_FULL_VER);
+#	else
+	snprintf(buf, sizeof(buf), "unknown");
+#	endif
+	info.compiler = buf;
+	info.compileFlags = HASHTEST_COMPILE_FLAGS;
+	info.gitRevision = HASHTEST_GIT_REVISION;
+
+	time_t now = time(NULL);
+	struct tm* t = gmtime(&now);
+	if (t && strftime(buf, sizeof(buf), "%Y-%m-%dT%H:%M:%SZ", t))
+		info.timestamp = buf;
+}
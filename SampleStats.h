@@ -0,0 +1,90 @@
+#pragma once
+
+// Summary statistics of repeated timing samples (e.g. MB/s of each test iteration).
+// Besides the usual min/median/mean/p90/stddev, gives a bootstrap 95% confidence interval
+// of the median: samples are resampled with replacement many times, and the 2.5% and 97.5%
+// percentiles of the resampled medians are the interval. That makes no assumption about
+// the sample distribution, which for timings is skewed (long tail of slow, disturbed runs).
+
+#include <vector>
+#include <algorithm>
+#include <stdint.h>
+#include <math.h>
+
+struct SampleStats
+{
+	SampleStats() : count(0), min(0), max(0), mean(0), median(0), p90(0), stddev(0), ciLow(0), ciHigh(0) { }
+	int count;
+	double min, max, mean, median, p90, stddev;
+	double ciLow, ciHigh; // 95% confidence interval of the median
+
+	// CI width relative to the median, in percent
+	double GetRelativeCIWidth() const { return median > 0 ? (ciHigh - ciLow) / median * 100.0 : 0.0; }
+};
+
+const int kBootstrapResamples = 1000;
+
+// p in [0,1] percentile of sorted values, linearly interpolated
+static double Percentile(const std::vector<double>& sorted, double p)
+{
+	if (sorted.empty())
+		return 0;
+	double pos = p * (sorted.size() - 1);
+	size_t i = (size_t)pos;
+	if (i + 1 >= sorted.size())
+		return sorted.back();
+	double frac = pos - i;
+	return sorted[i] + (sorted[i+1] - sorted[i]) * frac;
+}
+
+static double Median(std::vector<double> values)
+{
+	std::sort(values.begin(), values.end());
+	return Percentile(values, 0.5);
+}
+
+template<typename T>
+static void ComputeSampleStats(const std::vector<T>& samples, SampleStats& out)
+{
+	out = SampleStats();
+	out.count = (int)samples.size();
+	if (samples.empty())
+		return;
+	std::vector<double> sorted(samples.begin(), samples.end());
+	std::sort(sorted.begin(), sorted.end());
+	const size_t n = sorted.size();
+	out.min = sorted.front();
+	out.max = sorted.back();
+	out.median = Percentile(sorted, 0.5);
+	out.p90 = Percentile(sorted, 0.9);
+	double sum = 0;
+	for (size_t i = 0; i < n; ++i)
+		sum += sorted[i];
+	out.mean = sum / n;
+	double var = 0;
+	for (size_t i = 0; i < n; ++i)
+		var += (sorted[i] - out.mean) * (sorted[i] - out.mean);
+	out.stddev = n > 1 ? sqrt(var / (n - 1)) : 0.0;
+
+	// bootstrap; fixed seed so that the same samples always give the same interval
+	uint64_t rng = 0x9E3779B97F4A7C15ULL;
+	std::vector<double> medians(kBootstrapResamples);
+	std::vector<double> resample(n);
+	for (int b = 0; b < kBootstrapResamples; ++b)
+	{
+		for (size_t i = 0; i < n; ++i)
+		{
+			// splitmix64
+			uint64_t z = (rng += 0x9E3779B97F4A7C15ULL);
+			z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ULL;
+			z = (z ^ (z >> 27)) * 0x94D049BB133111EBULL;
+			z ^= z >> 31;
+			resample[i] = sorted[(size_t)(z % n)];
+		}
+		std::sort(resample.begin(), resample.end());
+		medians[b] = Percentile(resample, 0.5);
+	}
+	std::sort(medians.begin(), medians.end());
+	out.ciLow = Percentile(medians, 0.025);
+	out.ciHigh = Percentile(medians, 0.975);
+}
@@ -0,0 +1,121 @@
+#pragma once
+
+// Minimal work-stealing task scheduler, used to spread independent test jobs
+// (e.g. quality evaluation of every hasher x dataset pair) over all CPU cores.
+//
+// Usage is a blocking "parallel for": RunTasks(count, func, userData) calls func(userData, i)
+// for every i in [0,count), and returns once all of them are done. Each worker thread owns a
+// queue of task indices; it takes work from the back of its own queue, and when that runs
+// dry steals from the front of other workers' queues. Tasks should write their results into
+// preallocated per-index slots, so that the output does not depend on execution order.
+
+#include "PlatformWrap.h"
+
+#include <vector>
+#include <deque>
+#include <stddef.h>
+
+#if PLATFORM_WEBGL
+#	define TASK_SCHEDULER_THREADS 0
+#else
+#	define TASK_SCHEDULER_THREADS 1
+#	include <thread>
+#	include <mutex>
+#endif
+
+class TaskScheduler
+{
+public:
+	typedef void (*TaskFunc)(void* userData, size_t index);
+
+	// threadCount <= 0 means "use all hardware threads"
+	explicit TaskScheduler(int threadCount)
+	{
+#		if TASK_SCHEDULER_THREADS
+		if (threadCount <= 0)
+			threadCount = (int)std::thread::hardware_concurrency();
+#		endif
+		if (threadCount <= 0)
+			threadCount = 1;
+		m_ThreadCount = threadCount;
+	}
+
+	int GetThreadCount() const { return m_ThreadCount; }
+
+	void RunTasks(size_t count, TaskFunc func, void* userData)
+	{
+#		if TASK_SCHEDULER_THREADS
+		if (m_ThreadCount > 1 && count > 1)
+		{
+			int workerCount = m_ThreadCount < (int)count ? m_ThreadCount : (int)count;
+			std::vector<WorkerQueue> queues(workerCount);
+			// deal out tasks round-robin, so that neighbouring (and often similarly sized)
+			// tasks start out on different workers
+			for (size_t i = 0; i < count; ++i)
+				queues[i % workerCount].tasks.push_back(i);
+
+			std::vector<std::thread> threads;
+			threads.reserve(workerCount - 1);
+			for (int w = 1; w < workerCount; ++w)
+				threads.push_back(std::thread(WorkerLoop, &queues, w, func, userData));
+			WorkerLoop(&queues, 0, func, userData); // calling thread is worker #0
+			for (size_t t = 0; t < threads.size(); ++t)
+				threads[t].join();
+			return;
+		}
+#		endif
+		for (size_t i = 0; i < count; ++i)
+			func(userData, i);
+	}
+
+private:
+#	if TASK_SCHEDULER_THREADS
+	struct WorkerQueue
+	{
+		std::mutex mutex;
+		std::deque<size_t> tasks;
+	};
+
+	static bool PopOwn(WorkerQueue& q, size_t& outTask)
+	{
+		std::lock_guard<std::mutex> lock(q.mutex);
+		if (q.tasks.empty())
+			return false;
+		outTask = q.tasks.back();
+		q.tasks.pop_back();
+		return true;
+	}
+	static bool Steal(WorkerQueue& q, size_t& outTask)
+	{
+		std::lock_guard<std::mutex> lock(q.mutex);
+		if (q.tasks.empty())
+			return false;
+		outTask = q.tasks.front();
+		q.tasks.pop_front();
+		return true;
+	}
+
+	static void WorkerLoop(std::vector<WorkerQueue>* queues, int self, TaskFunc func, void* userData)
+	{
+		const int workerCount = (int)queues->size();
+		size_t task;
+		for (;;)
+		{
+			if (PopOwn((*queues)[self], task))
+			{
+				func(userData, task);
+				continue;
+			}
+			// no tasks are ever added once running, so if every queue is empty we're done
+			bool stole = false;
+			for (int i = 1; i < workerCount && !stole; ++i)
+				stole = Steal((*queues)[(self + i) % workerCount], task);
+			if (!stole)
+				return;
+			func(userData, task);
+		}
+	}
+#	endif
+
+	int m_ThreadCount;
+};
@@ -1 +1,3 @@
-g++ -DPLATFORM_APPLE=1 -Os `find | grep -e "\.c"`
+FLAGS="-Os -pthread"
+REVISION=`git describe --always --dirty 2>/dev/null || echo unknown`
+g++ $FLAGS -DHASHTEST_COMPILE_FLAGS="\"$FLAGS\"" -DHASHTEST_GIT_REVISION="\"$REVISION\"" `find | grep -e "\.c"`
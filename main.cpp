@@ -1,10 +1,18 @@
 #include "PlatformWrap.h"
+#include "TaskScheduler.h"
+#include "CollisionCounters.h"
+#include "LineSplitter.h"
+#include "RunInfo.h"
+#include "SampleStats.h"
+#include "PerfCounters.h"
+#include "HashTables.h"
 
 #include "HashFunctions/city.h"
 #include "HashFunctions/farmhash.h"
 #include "HashFunctions/mum.h"
 #include "HashFunctions/MurmurHash2.h"
 #include "HashFunctions/MurmurHash3.h"
+#include "HashFunctions/Platform.h"
 #include "HashFunctions/SimpleHashFunctions.h"
 #include "HashFunctions/sha1.h"
 #include "HashFunctions/SpookyV2.h"
@@ -12,16 +20,31 @@
 
 #include <vector>
 #include <string>
-#include <set>
 #include <map>
+#include <memory>
+#include <new>
+#include <algorithm>
 #include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
 #include <math.h>
+#if PLATFORM_MICROSOFT
+#	include <malloc.h>
+#endif
+#if TASK_SCHEDULER_THREADS
+#	include <thread>
+#	include <mutex>
+#	include <condition_variable>
+#	include <chrono>
+#endif
 
 #if PLATFORM_ANDROID
 android_app* g_AndroidApp;
 #endif
 
 FILE* g_OutputFile = stdout;
+static int g_WorkerThreadCount = 0; // worker threads for quality evals & data loading, 0 = all cores
 
 extern void crc32 (const void * key, int len, uint32_t seed, void * out);
 extern void md5_32 (const void * key, int len, uint32_t /*seed*/, void * out);
@@ -31,17 +54,630 @@ extern "C" int siphash(uint8_t *out, const uint8_t *in, uint64_t inlen, const ui
 // ------------------------------------------------------------------------------------
 // Data sets & reading them from file
 
-struct DataSet
+#if PLATFORM_LINUX || PLATFORM_MAC
+#	define DATASET_MMAP 1
+#	include <sys/mman.h>
+#	include <sys/stat.h>
+#	include <fcntl.h>
+#	include <unistd.h>
+#endif
+
+static bool g_DataSetMmap = true; // memory map dataset files instead of reading them, where supported
+static bool g_DataSetIndex = true; // use (and create if needed) binary .idx sidecar files with dataset entries, where supported
+const size_t kDataSetScanChunkSize = 16 * 1024 * 1024; // newline scanning is split into chunks of this size, done in parallel
+
+#if !PLATFORM_ANDROID
+#	define DATASET_STREAMING 1
+#endif
+static uint64_t g_DataSetStreamThreshold = 4ull * 1024 * 1024 * 1024; // data sets larger than this are streamed instead of loaded into memory
+const size_t kDataSetStreamWindowSize = 64 * 1024 * 1024;
+
+// Table of dataset entries (offset & length of each one in the file data), in structure-of-arrays
+// layout with the narrowest types that fit: offsets are 32 bit unless the file is over 4GB, lengths
+// are 8, 16 or 32 bit depending on the longest entry. For a typical text dataset that is 5 bytes per
+// entry instead of 16 for a pair of size_t. The lengths array directly follows the offsets array in
+// memory; both either live in the table itself, or in a memory mapped dataset index file.
+class DataSetEntries
 {
-	DataSet() : totalSize(0) { }
+public:
+	DataSetEntries() : m_Count(0), m_OffsetSize(4), m_LengthSize(1), m_Offsets(NULL), m_Lengths(NULL) { }
+
+	size_t size() const { return m_Count; }
+	uint32_t GetOffsetSize() const { return m_OffsetSize; }
+	uint32_t GetLengthSize() const { return m_LengthSize; }
+	const void* GetData() const { return m_Offsets; } // offsets followed by lengths
+	size_t GetDataSize() const { return m_Count * (m_OffsetSize + m_LengthSize); }
+
+	static uint32_t OffsetSizeFor(uint64_t maxOffset) { return maxOffset <= 0xFFFFFFFFull ? 4 : 8; }
+	static uint32_t LengthSizeFor(uint64_t maxLength) { return maxLength <= 0xFF ? 1 : (maxLength <= 0xFFFF ? 2 : 4); }
+
+	// Allocate storage for count entries, then fill them with Set()
+	void Allocate(size_t count, uint32_t offsetSize, uint32_t lengthSize)
+	{
+		m_Storage.resize((count * (offsetSize + lengthSize) + 7) / 8);
+		SetArrays(count, offsetSize, lengthSize, m_Storage.data());
+	}
+	// Use externally owned data (offsets followed by lengths), e.g. a memory mapped index file
+	void SetExternal(size_t count, uint32_t offsetSize, uint32_t lengthSize, const void* data)
+	{
+		m_Storage.clear();
+		SetArrays(count, offsetSize, lengthSize, data);
+	}
+	void clear()
+	{
+		m_Storage.clear();
+		SetArrays(0, 4, 1, NULL);
+	}
+
+	void Set(size_t i, size_t offset, size_t length)
+	{
+		void* offsets = const_cast<void*>(m_Offsets);
+		void* lengths = const_cast<void*>(m_Lengths);
+		if (m_OffsetSize == 4)
+			((uint32_t*)offsets)[i] = (uint32_t)offset;
+		else
+			((uint64_t*)offsets)[i] = offset;
+		switch (m_LengthSize)
+		{
+		case 1: ((uint8_t*)lengths)[i] = (uint8_t)length; break;
+		case 2: ((uint16_t*)lengths)[i] = (uint16_t)length; break;
+		default: ((uint32_t*)lengths)[i] = (uint32_t)length; break;
+		}
+	}
+	size_t GetOffset(size_t i) const
+	{
+		return m_OffsetSize == 4 ? (size_t)((const uint32_t*)m_Offsets)[i] : (size_t)((const uint64_t*)m_Offsets)[i];
+	}
+	size_t GetLength(size_t i) const
+	{
+		switch (m_LengthSize)
+		{
+		case 1: return ((const uint8_t*)m_Lengths)[i];
+		case 2: return ((const uint16_t*)m_Lengths)[i];
+		default: return ((const uint32_t*)m_Lengths)[i];
+		}
+	}
+
+	// Calls func(offset, length) for all entries in order; the loop is specialized for
+	// the actual array element types, so it's a plain linear walk over both arrays.
+	template<typename Func>
+	void ForEach(Func& func) const
+	{
+		ForEachFirst(m_Count, func);
+	}
+	// Same, for the first count entries only
+	template<typename Func>
+	void ForEachFirst(size_t count, Func& func) const
+	{
+		ForEachInRange(0, count, func);
+	}
+	// Same, for entries [begin,end) only
+	template<typename Func>
+	void ForEachInRange(size_t begin, size_t end, Func& func) const
+	{
+		end = end < m_Count ? end : m_Count;
+		if (m_OffsetSize == 4)
+		{
+			switch (m_LengthSize)
+			{
+			case 1: ForEachTyped<uint32_t, uint8_t>(begin, end, func); break;
+			case 2: ForEachTyped<uint32_t, uint16_t>(begin, end, func); break;
+			default: ForEachTyped<uint32_t, uint32_t>(begin, end, func); break;
+			}
+		}
+		else
+		{
+			switch (m_LengthSize)
+			{
+			case 1: ForEachTyped<uint64_t, uint8_t>(begin, end, func); break;
+			case 2: ForEachTyped<uint64_t, uint16_t>(begin, end, func); break;
+			default: ForEachTyped<uint64_t, uint32_t>(begin, end, func); break;
+			}
+		}
+	}
+	// Calls func(offset, length) for entries order[0..count), in that order
+	template<typename Func>
+	void ForEachPermuted(const uint32_t* order, size_t count, Func& func) const
+	{
+		if (m_OffsetSize == 4)
+		{
+			switch (m_LengthSize)
+			{
+			case 1: ForEachPermutedTyped<uint32_t, uint8_t>(order, count, func); break;
+			case 2: ForEachPermutedTyped<uint32_t, uint16_t>(order, count, func); break;
+			default: ForEachPermutedTyped<uint32_t, uint32_t>(order, count, func); break;
+			}
+		}
+		else
+		{
+			switch (m_LengthSize)
+			{
+			case 1: ForEachPermutedTyped<uint64_t, uint8_t>(order, count, func); break;
+			case 2: ForEachPermutedTyped<uint64_t, uint16_t>(order, count, func); break;
+			default: ForEachPermutedTyped<uint64_t, uint32_t>(order, count, func); break;
+			}
+		}
+	}
+
+private:
+	void SetArrays(size_t count, uint32_t offsetSize, uint32_t lengthSize, const void* data)
+	{
+		m_Count = count;
+		m_OffsetSize = offsetSize;
+		m_LengthSize = lengthSize;
+		m_Offsets = data;
+		m_Lengths = (const uint8_t*)data + count * offsetSize;
+	}
+	template<typename OffsetType, typename LengthType, typename Func>
+	void ForEachTyped(size_t begin, size_t end, Func& func) const
+	{
+		const OffsetType* offsets = (const OffsetType*)m_Offsets;
+		const LengthType* lengths = (const LengthType*)m_Lengths;
+		for (size_t i = begin; i < end; ++i)
+			func((size_t)offsets[i], (size_t)lengths[i]);
+	}
+	template<typename OffsetType, typename LengthType, typename Func>
+	void ForEachPermutedTyped(const uint32_t* order, size_t count, Func& func) const
+	{
+		const OffsetType* offsets = (const OffsetType*)m_Offsets;
+		const LengthType* lengths = (const LengthType*)m_Lengths;
+		for (size_t i = 0; i != count; ++i)
+			func((size_t)offsets[order[i]], (size_t)lengths[order[i]]);
+	}
+
+	size_t m_Count;
+	uint32_t m_OffsetSize;
+	uint32_t m_LengthSize;
+	const void* m_Offsets;
+	const void* m_Lengths;
+	std::vector<uint64_t> m_Storage;
+};
 
-	typedef std::pair<size_t,size_t> OffsetAndSize;
+struct DataSet
+{
+	DataSet() : fileData(NULL), fileSize(0), mappedSize(0), indexData(NULL), indexMappedSize(0), totalSize(0), streamEntryCount(0) { }
+	~DataSet()
+	{
+#		if DATASET_MMAP
+		if (mappedSize)
+			munmap((void*)fileData, mappedSize);
+		if (indexMappedSize)
+			munmap(indexData, indexMappedSize);
+#		endif
+	}
 
 	std::string name;
-	std::vector<char> buffer; // raw file contents
-	std::vector<OffsetAndSize> entries; // entries in the file data array, each has offset and length
+	std::vector<char> buffer; // raw file contents, when the file is not memory mapped
+	const char* fileData; // raw file contents; points into buffer, or into the memory mapped file
+	size_t fileSize;
+	size_t mappedSize; // non-zero if file is memory mapped
+	void* indexData; // memory mapped index file that entries point into, if any
+	size_t indexMappedSize;
+	DataSetEntries entries; // entries in the file data array, each has offset and length
 	size_t totalSize; // total size of data that will be hashed (file size, minus all entry delimiters)
+
+	// Streamed data sets are not loaded into memory (no file data or entries); they are read
+	// piece by piece with DataSetStreamReader when needed.
+	std::string streamPath;
+	size_t streamEntryCount;
+
+	bool IsStreamed() const { return !streamPath.empty(); }
+	size_t GetEntryCount() const { return IsStreamed() ? streamEntryCount : entries.size(); }
+};
+
+#if DATASET_MMAP
+static bool MapDataSetFile(DataSet& data, int fd, size_t size)
+{
+	int flags = MAP_PRIVATE;
+#	if defined(MAP_POPULATE)
+	flags |= MAP_POPULATE; // fault in the whole file now, instead of while hashing
+#	endif
+	void* ptr = mmap(NULL, size, PROT_READ, flags, fd, 0);
+	if (ptr == MAP_FAILED)
+		return false;
+#	if !defined(MAP_POPULATE)
+	madvise(ptr, size, MADV_WILLNEED);
+#	endif
+	data.fileData = (const char*)ptr;
+	data.fileSize = size;
+	data.mappedSize = size;
+	return true;
+}
+#endif
+
+struct NewlineScanJob
+{
+	const char* data;
+	size_t size;
+	std::vector<std::vector<size_t> > chunkNewlines;
+};
+
+static void NewlineScanTask(void* userData, size_t index)
+{
+	NewlineScanJob& job = *(NewlineScanJob*)userData;
+	size_t begin = index * kDataSetScanChunkSize;
+	size_t end = begin + kDataSetScanChunkSize;
+	if (end > job.size)
+		end = job.size;
+	FindNewlines(job.data, begin, end, job.chunkNewlines[index]);
+}
+
+// Calls func(offset, length) for every text line found by the newline scan job; any
+// trailing Windows style newlines are not part of the line.
+template<typename Func>
+static void ForEachScannedLine(const NewlineScanJob& job, Func& func)
+{
+	const char* buffer = job.data;
+	size_t wordStart = 0;
+	for (size_t ic = 0; ic < job.chunkNewlines.size(); ++ic)
+	{
+		const std::vector<size_t>& newlines = job.chunkNewlines[ic];
+		for (size_t i = 0, n = newlines.size(); i != n; ++i)
+		{
+			size_t pos = newlines[i];
+			size_t wordEnd = pos;
+			// remove any trailing Windows style newlines
+			while (wordEnd > wordStart+1 && buffer[wordEnd-1] == '\r')
+				--wordEnd;
+			func(wordStart, wordEnd-wordStart);
+			wordStart = pos+1;
+		}
+	}
+}
+
+// Builds dataset entries, one per text line (the part after last newline, if any, is ignored).
+static void SplitDataSetEntries(DataSet& data)
+{
+	NewlineScanJob job;
+	job.data = data.fileData;
+	job.size = data.fileSize;
+	job.chunkNewlines.resize((job.size + kDataSetScanChunkSize - 1) / kDataSetScanChunkSize);
+	TaskScheduler scheduler(g_WorkerThreadCount);
+	scheduler.RunTasks(job.chunkNewlines.size(), NewlineScanTask, &job);
+
+	// first pass to find the entry count & longest entry, so that we can pick entry table element sizes
+	size_t lineCount = 0, maxLength = 0, totalSize = 0;
+	auto measure = [&](size_t /*offset*/, size_t length)
+	{
+		++lineCount;
+		totalSize += length;
+		if (length > maxLength)
+			maxLength = length;
+	};
+	ForEachScannedLine(job, measure);
+	data.totalSize = totalSize;
+
+	data.entries.Allocate(lineCount, DataSetEntries::OffsetSizeFor(data.fileSize), DataSetEntries::LengthSizeFor(maxLength));
+	size_t index = 0;
+	auto store = [&](size_t offset, size_t length) { data.entries.Set(index++, offset, length); };
+	ForEachScannedLine(job, store);
+}
+
+#if DATASET_STREAMING
+
+// Reads a data set file in windows of whole lines: each window is returned as a DataSet
+// that points into the reader's buffers. Two windows are used in turns; while the caller
+// works on one, the next one is read & split on a background thread. A single line longer
+// than the window size makes that window grow to fit it.
+class DataSetStreamReader
+{
+public:
+	DataSetStreamReader() : m_File(NULL), m_Current(-1) { }
+	~DataSetStreamReader() { Close(); }
+
+	bool Open(const std::string& path)
+	{
+		m_File = fopen(path.c_str(), "rb");
+		if (!m_File)
+			return false;
+		m_Carry.clear();
+		m_Current = -1;
+		m_State[0] = m_State[1] = kSlotFree;
+#		if TASK_SCHEDULER_THREADS
+		m_Stop = false;
+		m_Thread = std::thread(ReaderThread, this);
+#		endif
+		return true;
+	}
+
+	void Close()
+	{
+		if (!m_File)
+			return;
+#		if TASK_SCHEDULER_THREADS
+		{
+			std::lock_guard<std::mutex> lock(m_Mutex);
+			m_Stop = true;
+		}
+		m_Cond.notify_all();
+		m_Thread.join();
+#		endif
+		fclose(m_File);
+		m_File = NULL;
+	}
+
+	// Next window of lines (valid until the next call), or NULL when the whole file is done.
+	const DataSet* NextWindow()
+	{
+		const int slot = m_Current < 0 ? 0 : (m_Current ^ 1);
+#		if TASK_SCHEDULER_THREADS
+		std::unique_lock<std::mutex> lock(m_Mutex);
+		if (m_Current >= 0)
+		{
+			m_State[m_Current] = kSlotFree; // caller is done with the previous window
+			m_Cond.notify_all();
+		}
+		while (m_State[slot] == kSlotFree)
+			m_Cond.wait(lock);
+#		else
+		m_State[slot] = FillSlot(slot);
+#		endif
+		m_Current = slot;
+		return m_State[slot] == kSlotFilled ? &m_Windows[slot] : NULL;
+	}
+
+private:
+	enum SlotState { kSlotFree, kSlotFilled, kSlotEnd };
+
+	SlotState FillSlot(int slot)
+	{
+		std::vector<char>& buffer = m_Buffers[slot];
+		if (buffer.size() < kDataSetStreamWindowSize)
+			buffer.resize(kDataSetStreamWindowSize);
+
+		// partial line left over from the previous window goes first
+		size_t used = m_Carry.size();
+		if (used)
+			memcpy(buffer.data(), m_Carry.data(), used);
+		size_t windowSize = 0;
+		for (;;)
+		{
+			size_t searchFrom = used;
+			used += fread(buffer.data() + used, 1, buffer.size() - used, m_File);
+			for (size_t pos = used; pos > searchFrom; --pos)
+			{
+				if (buffer[pos-1] == '\n')
+				{
+					windowSize = pos;
+					break;
+				}
+			}
+			if (windowSize || used < buffer.size())
+				break; // found a line end, or hit end of file
+			buffer.resize(buffer.size() * 2);
+		}
+		if (!windowSize)
+			return kSlotEnd; // like for regular data sets, data after the last newline is ignored
+
+		m_Carry.assign(buffer.data() + windowSize, buffer.data() + used);
+		DataSet& window = m_Windows[slot];
+		window.fileData = buffer.data();
+		window.fileSize = windowSize;
+		SplitDataSetEntries(window);
+		return kSlotFilled;
+	}
+
+#	if TASK_SCHEDULER_THREADS
+	static void ReaderThread(DataSetStreamReader* self)
+	{
+		for (int slot = 0; ; slot ^= 1)
+		{
+			{
+				std::unique_lock<std::mutex> lock(self->m_Mutex);
+				while (!self->m_Stop && self->m_State[slot] != kSlotFree)
+					self->m_Cond.wait(lock);
+				if (self->m_Stop)
+					return;
+			}
+			SlotState state = self->FillSlot(slot);
+			{
+				std::lock_guard<std::mutex> lock(self->m_Mutex);
+				self->m_State[slot] = state;
+			}
+			self->m_Cond.notify_all();
+			if (state == kSlotEnd)
+				return;
+		}
+	}
+
+	std::thread m_Thread;
+	std::mutex m_Mutex;
+	std::condition_variable m_Cond;
+	bool m_Stop;
+#	endif
+
+	FILE* m_File;
+	int m_Current;
+	SlotState m_State[2];
+	std::vector<char> m_Buffers[2];
+	DataSet m_Windows[2];
+	std::vector<char> m_Carry; // only touched by the reading thread
+};
+
+// Streamed data sets still need entry count & total size upfront (e.g. for hashtable size in
+// quality tests). These come from the .idx file where possible (see LoadDataSetIndexCounts);
+// otherwise read through the whole file once when "loading" them.
+static bool CountStreamedDataSetEntries(DataSet& data)
+{
+	DataSetStreamReader reader;
+	if (!reader.Open(data.streamPath))
+		return false;
+	data.streamEntryCount = 0;
+	data.totalSize = 0;
+	while (const DataSet* window = reader.NextWindow())
+	{
+		data.streamEntryCount += window->entries.size();
+		data.totalSize += window->totalSize;
+	}
+	return true;
+}
+
+#endif // #if DATASET_STREAMING
+
+#if DATASET_MMAP
+
+// Binary index sidecar file (dataset filename + ".idx"), so that entries don't need to be
+// rebuilt by scanning the whole dataset on every run. Layout:
+// - DataSetIndexHeader
+// - entryCount offsets, each offsetSize bytes (4 if the dataset is < 4GB, 8 otherwise)
+// - entryCount lengths, each lengthSize bytes (1, 2 or 4, depending on the longest entry)
+// i.e. the payload is exactly the DataSetEntries table data, and gets used from the mapped file.
+// The index is used only if dataset file size & modification time (with nanoseconds, so that
+// a same size edit within the same second is noticed) match what was recorded, and the checksum
+// of the offsets & lengths arrays is right; otherwise it is rebuilt.
+struct DataSetIndexHeader
+{
+	char magic[8];
+	uint32_t version;
+	uint32_t offsetSize;
+	uint32_t lengthSize;
+	uint32_t padding;
+	uint64_t fileSize;
+	int64_t fileModTime; // seconds
+	int64_t fileModTimeNsec;
+	uint64_t entryCount;
+	uint64_t totalSize;
+	uint64_t payloadChecksum; // XXH64 of everything after the header
 };
+static_assert(sizeof(DataSetIndexHeader) % 8 == 0, "index payload must stay 8 byte aligned, entry table points into it");
+static const char kDataSetIndexMagic[8] = { 'H','F','T','I','D','X','\0','\0' };
+const uint32_t kDataSetIndexVersion = 2;
+const uint64_t kDataSetIndexChecksumSeed = 0x1234;
+
+static int64_t GetFileModTimeNsec(const struct stat& fileStat)
+{
+#	if PLATFORM_MAC
+	return fileStat.st_mtimespec.tv_nsec;
+#	else
+	return fileStat.st_mtim.tv_nsec;
+#	endif
+}
+
+static bool LoadDataSetIndex(DataSet& data, const std::string& indexPath, const struct stat& fileStat)
+{
+	int fd = open(indexPath.c_str(), O_RDONLY);
+	if (fd < 0)
+		return false;
+	struct stat indexStat;
+	void* ptr = MAP_FAILED;
+	if (fstat(fd, &indexStat) == 0 && (size_t)indexStat.st_size >= sizeof(DataSetIndexHeader))
+		ptr = mmap(NULL, indexStat.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+	close(fd);
+	if (ptr == MAP_FAILED)
+		return false;
+
+	const size_t indexSize = indexStat.st_size;
+	const DataSetIndexHeader& header = *(const DataSetIndexHeader*)ptr;
+	const uint8_t* payload = (const uint8_t*)ptr + sizeof(DataSetIndexHeader);
+	const size_t payloadSize = indexSize - sizeof(DataSetIndexHeader);
+	bool valid =
+		memcmp(header.magic, kDataSetIndexMagic, sizeof(kDataSetIndexMagic)) == 0 &&
+		header.version == kDataSetIndexVersion &&
+		header.fileSize == (uint64_t)fileStat.st_size &&
+		header.fileModTime == (int64_t)fileStat.st_mtime &&
+		header.fileModTimeNsec == GetFileModTimeNsec(fileStat) &&
+		(header.offsetSize == 4 || header.offsetSize == 8) &&
+		(header.lengthSize == 1 || header.lengthSize == 2 || header.lengthSize == 4) &&
+		header.entryCount * (header.offsetSize + header.lengthSize) == payloadSize &&
+		XXH64(payload, payloadSize, kDataSetIndexChecksumSeed) == header.payloadChecksum;
+	if (valid)
+	{
+		// entry table points directly into the mapped index; just check that entries are within the file
+		data.entries.SetExternal((size_t)header.entryCount, header.offsetSize, header.lengthSize, payload);
+		size_t endMax = 0;
+		auto check = [&](size_t offset, size_t length)
+		{
+			if (offset + length > endMax)
+				endMax = offset + length;
+		};
+		data.entries.ForEach(check);
+		valid = endMax <= data.fileSize;
+	}
+	if (!valid)
+	{
+		data.entries.clear();
+		munmap(ptr, indexSize);
+		return false;
+	}
+	data.indexData = ptr;
+	data.indexMappedSize = indexSize;
+	data.totalSize = (size_t)header.totalSize;
+	return true;
+}
+
+static void WriteDataSetIndexFile(const std::string& indexPath, const struct stat& fileStat, DataSetIndexHeader& header, uint64_t entryCount, uint64_t totalSize, const void* payload, size_t payloadSize)
+{
+	memcpy(header.magic, kDataSetIndexMagic, sizeof(kDataSetIndexMagic));
+	header.version = kDataSetIndexVersion;
+	header.fileSize = fileStat.st_size;
+	header.fileModTime = fileStat.st_mtime;
+	header.fileModTimeNsec = GetFileModTimeNsec(fileStat);
+	header.entryCount = entryCount;
+	header.totalSize = totalSize;
+	header.payloadChecksum = XXH64(payload, payloadSize, kDataSetIndexChecksumSeed);
+
+	// write to a temporary file (unique per process) & rename, so that concurrent runs never see
+	// a partial index, nor write into the same temporary file
+	char tmpSuffix[32];
+	snprintf(tmpSuffix, sizeof(tmpSuffix), ".%i.tmp", (int)getpid());
+	std::string tmpPath = indexPath + tmpSuffix;
+	FILE* f = fopen(tmpPath.c_str(), "wb");
+	if (!f)
+		return; // e.g. read-only dataset folder; just keep working without the index
+	bool ok = fwrite(&header, sizeof(header), 1, f) == 1;
+	if (payloadSize)
+		ok = ok && fwrite(payload, payloadSize, 1, f) == 1;
+	ok = (fclose(f) == 0) && ok;
+	if (!ok || rename(tmpPath.c_str(), indexPath.c_str()) != 0)
+		remove(tmpPath.c_str());
+}
+
+static void WriteDataSetIndex(const DataSet& data, const std::string& indexPath, const struct stat& fileStat)
+{
+	// payload is the entry table data as is
+	DataSetIndexHeader header;
+	memset(&header, 0, sizeof(header));
+	header.offsetSize = data.entries.GetOffsetSize();
+	header.lengthSize = data.entries.GetLengthSize();
+	WriteDataSetIndexFile(indexPath, fileStat, header, data.entries.size(), data.totalSize, data.entries.GetData(), data.entries.GetDataSize());
+}
+
+#if DATASET_STREAMING
+// Streamed data sets only need the entry count & total size out of an index, i.e. the header.
+// Index files for them are written header only (zero offset & length sizes, no payload), but a
+// full index from a run with a higher --stream-threshold works too. The payload is not checked.
+static bool LoadDataSetIndexCounts(DataSet& data, const std::string& indexPath, const struct stat& fileStat)
+{
+	FILE* f = fopen(indexPath.c_str(), "rb");
+	if (!f)
+		return false;
+	DataSetIndexHeader header;
+	struct stat indexStat;
+	bool valid = fread(&header, sizeof(header), 1, f) == 1 && fstat(fileno(f), &indexStat) == 0;
+	fclose(f);
+	valid = valid &&
+		memcmp(header.magic, kDataSetIndexMagic, sizeof(kDataSetIndexMagic)) == 0 &&
+		header.version == kDataSetIndexVersion &&
+		header.fileSize == (uint64_t)fileStat.st_size &&
+		header.fileModTime == (int64_t)fileStat.st_mtime &&
+		header.fileModTimeNsec == GetFileModTimeNsec(fileStat) &&
+		header.entryCount * (header.offsetSize + header.lengthSize) == (uint64_t)indexStat.st_size - sizeof(header);
+	if (!valid)
+		return false;
+	data.streamEntryCount = (size_t)header.entryCount;
+	data.totalSize = (size_t)header.totalSize;
+	return true;
+}
+
+static void WriteDataSetIndexCounts(const DataSet& data, const std::string& indexPath, const struct stat& fileStat)
+{
+	DataSetIndexHeader header;
+	memset(&header, 0, sizeof(header));
+	WriteDataSetIndexFile(indexPath, fileStat, header, data.streamEntryCount, data.totalSize, NULL, 0);
+}
+#endif // #if DATASET_STREAMING
+
+#endif // #if DATASET_MMAP
 
 static DataSet* ReadDataSet(const char* folderName, const char* filenameStr)
 {
@@ -75,41 +711,72 @@ static DataSet* ReadDataSet(const char* folderName, const char* filenameStr)
 	size_t size = ftell(f);
 	fseek(f, 0, SEEK_SET);
 
-	data->buffer.resize(size);
-	char* buffer = data->buffer.data();
-	fread(buffer, size, 1, f);
+	if (size > g_DataSetStreamThreshold)
+	{
+#		if DATASET_MMAP
+		struct stat fileStat;
+		const bool useIndex = g_DataSetIndex && fstat(fileno(f), &fileStat) == 0;
+		const std::string indexPath = fullPath + ".idx";
+#		endif
+		fclose(f);
+		data->streamPath = fullPath;
+		data->fileSize = size;
+#		if DATASET_MMAP
+		if (useIndex && LoadDataSetIndexCounts(*data, indexPath, fileStat))
+			return data;
+#		endif
+		if (!CountStreamedDataSetEntries(*data))
+		{
+			fprintf(g_OutputFile, "error: can't read dataset file '%s'\n", filename.c_str());
+			delete data;
+			return NULL;
+		}
+#		if DATASET_MMAP
+		if (useIndex)
+			WriteDataSetIndexCounts(*data, indexPath, fileStat);
+#		endif
+		return data;
+	}
+
+#	if DATASET_MMAP
+	if (g_DataSetMmap && size > 0)
+		MapDataSetFile(*data, fileno(f), size);
+	struct stat fileStat;
+	bool haveFileStat = fstat(fileno(f), &fileStat) == 0;
+#	endif
+	if (!data->fileData)
+	{
+		data->buffer.resize(size);
+		fread(data->buffer.data(), size, 1, f);
+		data->fileData = data->buffer.data();
+		data->fileSize = size;
+	}
+	fclose(f);
+
+#	if DATASET_MMAP
+	if (g_DataSetIndex && haveFileStat)
+	{
+		std::string indexPath = fullPath + ".idx";
+		if (!LoadDataSetIndex(*data, indexPath, fileStat))
+		{
+			SplitDataSetEntries(*data);
+			WriteDataSetIndex(*data, indexPath, fileStat);
+		}
+		return data;
+	}
+#	endif
 #	else
 	size_t size = AAsset_getLength(asset);
 	assert(size > 0);
 
 	data->buffer.resize(size);
-	char* buffer = data->buffer.data();
-
-	AAsset_read(asset, buffer, size);
+	AAsset_read(asset, data->buffer.data(), size);
 	AAsset_close(asset);
+	data->fileData = data->buffer.data();
+	data->fileSize = size;
 #	endif
 
-	size_t pos = 0;
-	size_t wordStart = 0;
-	data->totalSize = 0;
-	while (pos < size)
-	{
-		if (buffer[pos] == '\n')
-		{
-			size_t wordEnd = pos;
-			// remove any trailing Windows style newlines
-			while (wordEnd > wordStart+1 && buffer[wordEnd-1] == '\r')
-				--wordEnd;
-			data->entries.push_back(std::make_pair(wordStart, wordEnd-wordStart));
-			data->totalSize += wordEnd-wordStart;
-			wordStart = pos+1;
-		}
-		++pos;
-	}
-	
-#if !PLATFORM_ANDROID	
-	fclose(f);
-#endif	
+	SplitDataSetEntries(*data);
 	return data;
 }
 
@@ -133,23 +800,102 @@ struct Result
 {
 	struct DataSetResult
 	{
-		DataSetResult() : hashsum(0), collisions(0), hashtabCollisionsIncrease(0) { }
+		DataSetResult() : hashsum(0), collisions(0), hashtabCollisionsIncrease(0), collisionsError(0), hashtabCollisionsIncreaseError(0) { }
 		uint32_t hashsum;
 		int collisions;
 		float hashtabCollisionsIncrease; // % of how much hashtable collisions we'd get, compared to an ideal hash
+		float collisionsError; // standard error of the two above, when they are estimates (zero if exact)
+		float hashtabCollisionsIncreaseError;
+		std::vector<float> reductionCollisionsIncrease; // when the reduction sweep is done: [load factor * kReductionCount + reduction], see BucketReductionCounter
 	};
 	struct PerfResult
 	{
-		PerfResult() : length(0), mbps(0), mbpsAligned(0) { }
+		PerfResult() : length(0), mbps(0), mbpsAligned(0), cyclesPerHash(0), cyclesPerByte(0), nsPerHash(0), latencyNsPerHash(0) { }
 		int length;
-		int mbps;
+		int mbps; // best of all iterations
 		int mbpsAligned;
+		float cyclesPerHash; // only on platforms with PLATFORM_HAS_CYCLE_COUNTER; unaligned test
+		float cyclesPerByte;
+		float nsPerHash; // throughput: independent hashes, unaligned test
+		float latencyNsPerHash; // latency: each hash input depends on the previous hash; when the latency test is done
+		std::vector<float> mbpsSamples; // MB/s of every iteration
+		std::vector<float> mbpsAlignedSamples;
+		SampleStats mbpsStats; // of the samples above, computed once all iterations are done
+		SampleStats mbpsAlignedStats;
+		PerfCounterValues counters; // per hash, from the unaligned iteration with fewest cycles; when counters are enabled
+	};
+	
+	struct ScalingResult
+	{
+		ScalingResult() : threads(0) { }
+		int threads;
+		std::vector<float> mbpsPerLength; // aggregate over all threads, best of all iterations; same lengths as mbpsPerLength in Result
+	};
+	struct HashTableResult
+	{
+		HashTableResult() : loadFactor(0), insertNs(0), hitNs(0), missNs(0), insertProbesAvg(0), hitProbesAvg(0), missProbesAvg(0), hitProbesMax(0), missProbesMax(0) { }
+		float loadFactor; // once all keys are in
+		float insertNs, hitNs, missNs; // per operation, best of all iterations
+		float insertProbesAvg, hitProbesAvg, missProbesAvg; // slots looked at per operation
+		int hitProbesMax, missProbesMax;
+	};
+	struct SwissTableResult
+	{
+		SwissTableResult() : loadFactor(0), insertNs(0), hitNs(0), missNs(0), hitGroupsAvg(0), missGroupsAvg(0), falseMatchesPerLookup(0), falseMatchRate(0) { }
+		float loadFactor; // once all keys are in
+		float insertNs, hitNs, missNs; // per operation, best of all iterations
+		float hitGroupsAvg, missGroupsAvg; // groups of 16 slots looked at per lookup
+		float falseMatchesPerLookup; // tag matches for other keys, over all lookups
+		float falseMatchRate; // % of occupied slots compared in lookups; ideal is 1/128 = 0.78%
+	};
+	struct RobinHoodResult
+	{
+		RobinHoodResult() : loadFactor(0), insertNs(0), hitNs(0), missNs(0), hitProbesMean(0), missProbesMean(0), hitProbesP99(0), hitProbesMax(0), missProbesP99(0), missProbesMax(0) { }
+		float loadFactor; // 0 if the data set has too few entries to get there
+		float insertNs; // per insert since the previous load factor; best of all iterations
+		float hitNs, missNs; // per lookup, best of all iterations
+		float hitProbesMean, missProbesMean;
+		int hitProbesP99, hitProbesMax, missProbesP99, missProbesMax;
+	};
+	struct KeyMixResult
+	{
+		KeyMixResult() : keysPerSec(0), mbps(0) { }
+		float keysPerSec; // best of all iterations
+		float mbps;
+	};
+	struct OffsetResult
+	{
+		OffsetResult() : offset(0) { }
+		int offset; // key start offset within a cache line, or kOffsetPageStraddle
+		std::vector<float> mbpsPerLength; // best of all iterations; same lengths as mbpsPerLength in Result, 0 if not possible
+	};
+	struct WorkingSetResult
+	{
+		WorkingSetResult() : size(0) { }
+		size_t size;
+		std::vector<float> mbpsPerLength; // best of all iterations; same lengths as mbpsPerLength in Result, 0 where length doesn't fit
 	};
 	
 	Result() : hashsum(0) { mbpsPerLength.reserve(32); }
 
 	std::string name;
 	std::vector<PerfResult> mbpsPerLength;
+	std::vector<WorkingSetResult> workingSets; // when the working set sweep is done
+	std::vector<ScalingResult> scaling; // when the thread scaling test is done
+	std::vector<OffsetResult> offsets; // when the misalignment sweep is done
+	std::vector<KeyMixResult> keyMixes; // when key mix tests are done; same order as g_KeyMixes
+	std::vector<HashTableResult> hashTables; // when hash table tests are done; same order as g_DataSets
+	std::vector<SwissTableResult> swissTables; // when Swiss table tests are done; same order as g_DataSets
+	std::vector<std::vector<RobinHoodResult> > robinHood; // when Robin Hood table tests are done; [data set][load factor], empty where data set is too small
+	struct BloomFilterResult
+	{
+		BloomFilterResult() : separateQps(0), separateBatchQps(0), doubleQps(0), doubleBatchQps(0), separateFalsePositiveRate(0), doubleFalsePositiveRate(0), expectedFalsePositiveRate(0) { }
+		float separateQps, separateBatchQps; // queries/s with k salted & remixed hash calls per key, one by one & batched; best of all iterations
+		float doubleQps, doubleBatchQps; // same, with double hashing of one hash call
+		float separateFalsePositiveRate, doubleFalsePositiveRate; // % of missing keys
+		float expectedFalsePositiveRate; // % for the filter's size & probe count
+	};
+	std::vector<BloomFilterResult> bloomFilters; // when Bloom filter tests are done; same order as g_DataSets
 	std::vector<DataSetResult> datasets;
 	uint32_t hashsum;
 };
@@ -165,39 +911,255 @@ static double CalculateExpectedCollisions(size_t bucketCount, size_t entryCount)
 }
 
 
-template<typename Hasher>
-void TestQualityOnDataSet(const DataSet& dataset, Result::DataSetResult& outResult)
+// Which engine TestQualityOnDataSet uses to count hash & bucket collisions, see CollisionCounters.h
+enum CollisionEngine
 {
-	Hasher hasher;
+	kCollisionEngineSort, // radix sorted array + bucket bitmap
+	kCollisionEngineSet, // std::set based reference implementation
+	kCollisionEngineEstimate, // HyperLogLog estimates (exact for small data sets); memory use does not grow with data set size
+};
+static CollisionEngine g_CollisionEngine = kCollisionEngineSort;
+// Streamed data sets are estimated unless an engine is given explicitly: with the exact engines memory
+// use grows with entry count (times hash function count, as all of them are fed at once).
+static CollisionEngine g_StreamCollisionEngine = kCollisionEngineEstimate;
 
-	// test for "hash quality":
-	// unique hashes found in all the entries (#entries - uniq == how many collisions found)
-	std::set<typename Hasher::HashType> uniq;
+// Bucket reduction sweep: hashtable collisions like above, for every BucketReduction way of
+// turning a hash into a bucket index, at each of kReductionLoadFactors. The collisions increase
+// there is not clamped at zero: a reduction can do better than a random hash would, e.g. with
+// sequential keys. Skipped on data sets too large for the bucket bitmaps.
+static bool g_RunReductionSweep = false;
+const size_t kReductionSweepMaxEntries = 16 * 1024 * 1024;
+static double g_ReductionNsPerHash[2][kReductionCount]; // [32/64 bit hash][reduction]; cost of each reduction alone
+
+// Hash quality test state for one hasher on one data set. Entries can be fed in several batches
+// (streamed data sets come in windows), results are produced at the end. With the estimate engine,
+// several accumulators can each see a disjoint shard of the entries, and then be merged into one
+// before End (see QualityShardJob); all of them Begin with the total entry count.
+class QualityAccumulator
+{
+public:
+	virtual ~QualityAccumulator() { }
+	virtual void Begin(size_t entryCount, bool reductionSweep) = 0;
+	virtual void Add(const DataSet& data, size_t begin, size_t end) = 0; // entries [begin,end) of data
+	virtual void Merge(const QualityAccumulator& other) = 0;
+	virtual void End(Result::DataSetResult& outResult) = 0;
+
+	void Add(const DataSet& data) { Add(data, 0, data.entries.size()); }
+};
+
+// Only the estimate engine can combine counters that saw disjoint parts of the data
+template<typename Counter>
+static void MergeCollisionCounters(Counter& /*counter*/, const Counter& /*other*/)
+{
+	assert(!"collision engine can't merge");
+}
+template<typename HashType>
+static void MergeCollisionCounters(EstimateCollisionCounter<HashType>& counter, const EstimateCollisionCounter<HashType>& other)
+{
+	counter.Merge(other);
+}
 
+template<typename Hasher, typename Counter>
+class QualityAccumulatorImpl : public QualityAccumulator
+{
+public:
+	// test for "hash quality":
+	// unique hashes found in all the entries (#entries - uniq == how many collisions found), and
 	// unique buckets that we'd end up with, if we had a hashtable with a load factor of 0.8 that is
 	// always power of two size.
-	std::set<typename Hasher::HashType> uniqModulo;
-	const size_t entryCount = dataset.entries.size();
-	size_t hashtableSize = NextPowerOfTwo(entryCount / 0.8);
-
-	double expectedCollisons = CalculateExpectedCollisions(hashtableSize, entryCount);
-	outResult.hashsum = 0;
-	for (size_t i = 0; i != entryCount; ++i)
+	virtual void Begin(size_t entryCount, bool reductionSweep)
+	{
+		m_EntryCount = entryCount;
+		m_HashtableSize = NextPowerOfTwo(entryCount / 0.8);
+		m_Hashsum = 0;
+		m_Counter.Begin(entryCount, m_HashtableSize);
+		m_Reductions.reset();
+		if (reductionSweep)
+		{
+			m_Reductions.reset(new BucketReductionCounter<HashType>());
+			m_Reductions->Begin(entryCount);
+		}
+	}
+	using QualityAccumulator::Add;
+	virtual void Add(const DataSet& data, size_t begin, size_t end)
+	{
+		uint32_t hashsum = m_Hashsum;
+		const char* fileData = data.fileData;
+		BucketReductionCounter<HashType>* reductions = m_Reductions.get();
+		auto hashEntry = [&](size_t offset, size_t length)
+		{
+			typename Hasher::HashType h = m_Hasher(fileData + offset, length);
+			hashsum ^= (uint32_t)h;
+			m_Counter.Add(h);
+			if (reductions)
+				reductions->Add(h);
+		};
+		data.entries.ForEachInRange(begin, end, hashEntry);
+		m_Hashsum = hashsum;
+	}
+	// no bucket reduction sweep when sharded; its counters can't merge
+	virtual void Merge(const QualityAccumulator& other)
 	{
-		typename Hasher::HashType h = hasher(dataset.buffer.data() + dataset.entries[i].first, dataset.entries[i].second);
-		outResult.hashsum ^= (uint32_t)h;
-		uniq.insert(h);
-		uniqModulo.insert(h % hashtableSize);
+		const QualityAccumulatorImpl& o = static_cast<const QualityAccumulatorImpl&>(other);
+		MergeCollisionCounters(m_Counter, o.m_Counter);
+		m_Hashsum ^= o.m_Hashsum;
 	}
-	outResult.collisions = (int)(entryCount - uniq.size());
+	virtual void End(Result::DataSetResult& outResult)
+	{
+		outResult.hashsum = m_Hashsum;
+		size_t uniqueHashes, usedBuckets;
+		m_Counter.End(uniqueHashes, usedBuckets);
+		// estimates can come out above entry count
+		if (uniqueHashes > m_EntryCount)
+			uniqueHashes = m_EntryCount;
+		if (usedBuckets > m_EntryCount)
+			usedBuckets = m_EntryCount;
+		outResult.collisions = (int)(m_EntryCount - uniqueHashes);
 
-	double hashtabCollisions = entryCount - uniqModulo.size();
-	double collisionsIncrease = (hashtabCollisions / expectedCollisons - 1.0) * 100;
-	if (collisionsIncrease < 0)
-		collisionsIncrease = 0;
-	outResult.hashtabCollisionsIncrease = collisionsIncrease;
-}
+		double expectedCollisons = CalculateExpectedCollisions(m_HashtableSize, m_EntryCount);
+		double hashtabCollisions = m_EntryCount - usedBuckets;
+		double collisionsIncrease = (hashtabCollisions / expectedCollisons - 1.0) * 100;
+		if (collisionsIncrease < 0)
+			collisionsIncrease = 0;
+		outResult.hashtabCollisionsIncrease = collisionsIncrease;
 
+		const double relError = m_Counter.GetRelativeError();
+		outResult.collisionsError = (float)(relError * uniqueHashes);
+		outResult.hashtabCollisionsIncreaseError = (float)(relError * usedBuckets / expectedCollisons * 100);
+
+		outResult.reductionCollisionsIncrease.clear();
+		if (!m_Reductions)
+			return;
+		outResult.reductionCollisionsIncrease.resize(kReductionLoadFactorCount * kReductionCount);
+		for (int il = 0; il < kReductionLoadFactorCount; ++il)
+		{
+			for (int ir = 0; ir < kReductionCount; ++ir)
+			{
+				const BucketReduction reduction = (BucketReduction)ir;
+				const double expected = CalculateExpectedCollisions(m_Reductions->GetTableSize(il, reduction), m_EntryCount);
+				const double collisions = double(m_EntryCount - m_Reductions->GetUsedBuckets(il, reduction));
+				outResult.reductionCollisionsIncrease[il * kReductionCount + ir] = expected > 0 ? (float)((collisions / expected - 1.0) * 100) : 0.0f;
+			}
+		}
+		m_Reductions.reset();
+	}
+
+private:
+	typedef typename Hasher::HashType HashType;
+	Hasher m_Hasher;
+	Counter m_Counter;
+	std::unique_ptr<BucketReductionCounter<HashType> > m_Reductions; // when the reduction sweep is done
+	size_t m_EntryCount;
+	size_t m_HashtableSize;
+	uint32_t m_Hashsum;
+};
+
+template<typename Hasher>
+QualityAccumulator* CreateQualityAccumulator(CollisionEngine engine)
+{
+	typedef typename Hasher::HashType HashType;
+	switch (engine)
+	{
+	case kCollisionEngineSet: return new QualityAccumulatorImpl<Hasher, SetCollisionCounter<HashType> >();
+	case kCollisionEngineEstimate: return new QualityAccumulatorImpl<Hasher, EstimateCollisionCounter<HashType> >();
+	default: return new QualityAccumulatorImpl<Hasher, SortCollisionCounter<HashType> >();
+	}
+}
+
+template<typename Hasher>
+void TestQualityOnDataSet(const DataSet& dataset, Result::DataSetResult& outResult)
+{
+	QualityAccumulator* acc = CreateQualityAccumulator<Hasher>(g_CollisionEngine);
+	acc->Begin(dataset.entries.size(), g_RunReductionSweep && dataset.entries.size() <= kReductionSweepMaxEntries);
+	acc->Add(dataset);
+	acc->End(outResult);
+	delete acc;
+}
+
+static uint64_t SplitMix64(uint64_t& state)
+{
+	uint64_t z = (state += 0x9E3779B97F4A7C15ULL);
+	z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ULL;
+	z = (z ^ (z >> 27)) * 0x94D049BB133111EBULL;
+	return z ^ (z >> 31);
+}
+
+// Cost of each bucket reduction by itself: reduce a list of random hashes into a table
+// sized for that many entries at load factor 0.75; best of a few runs.
+const size_t kReductionCostHashCount = 1024 * 1024;
+const int kReductionCostIterations = 5;
+static volatile size_t g_ReductionCostSink;
+
+template<typename HashType, BucketReduction reduction>
+static double MeasureReductionNs(const std::vector<HashType>& hashes)
+{
+	const size_t tableSize = GetReductionTableSize(reduction, hashes.size(), 0.75);
+	int sizeBits = 0;
+	while ((size_t(1) << sizeBits) < tableSize)
+		++sizeBits;
+	float best = 0;
+	for (int iter = 0; iter < kReductionCostIterations; ++iter)
+	{
+		size_t sum = 0;
+		TimerBegin();
+		for (size_t i = 0, n = hashes.size(); i < n; ++i)
+			sum += ReduceHash(hashes[i], reduction, tableSize, sizeBits);
+		float sec = TimerEnd();
+		g_ReductionCostSink = sum;
+		if (iter == 0 || sec < best)
+			best = sec;
+	}
+	return best * 1.0e9 / hashes.size();
+}
+
+template<typename HashType>
+static void MeasureReductionCosts(double outNs[kReductionCount])
+{
+	std::vector<HashType> hashes(kReductionCostHashCount);
+	uint64_t rng = 0x9E3779B97F4A7C15ULL;
+	for (size_t i = 0; i < hashes.size(); ++i)
+		hashes[i] = (HashType)SplitMix64(rng);
+	outNs[kReductionMask] = MeasureReductionNs<HashType, kReductionMask>(hashes);
+	outNs[kReductionPrime] = MeasureReductionNs<HashType, kReductionPrime>(hashes);
+	outNs[kReductionFastrange] = MeasureReductionNs<HashType, kReductionFastrange>(hashes);
+	outNs[kReductionFibonacci] = MeasureReductionNs<HashType, kReductionFibonacci>(hashes);
+}
+
+
+// Synthetic test data starts at a page boundary, so that key offsets within cache lines & pages
+// are what the tests say they are (a large std::vector of bytes typically starts 16 bytes into a page).
+template<typename T>
+struct PageAlignedAllocator
+{
+	typedef T value_type;
+	enum { kAlignment = 4096 };
+	PageAlignedAllocator() { }
+	template<typename U> PageAlignedAllocator(const PageAlignedAllocator<U>&) { }
+	T* allocate(size_t count)
+	{
+#		if PLATFORM_MICROSOFT
+		void* ptr = _aligned_malloc(count * sizeof(T), kAlignment);
+#		else
+		void* ptr = NULL;
+		if (posix_memalign(&ptr, kAlignment, count * sizeof(T)) != 0)
+			ptr = NULL;
+#		endif
+		if (!ptr)
+			throw std::bad_alloc();
+		return (T*)ptr;
+	}
+	void deallocate(T* ptr, size_t /*count*/)
+	{
+#		if PLATFORM_MICROSOFT
+		_aligned_free(ptr);
+#		else
+		free(ptr);
+#		endif
+	}
+};
+template<typename T, typename U> bool operator==(const PageAlignedAllocator<T>&, const PageAlignedAllocator<U>&) { return true; }
+template<typename T, typename U> bool operator!=(const PageAlignedAllocator<T>&, const PageAlignedAllocator<U>&) { return false; }
+typedef std::vector<uint8_t, PageAlignedAllocator<uint8_t> > SyntheticData;
 
 const size_t kSyntheticDataTotalSize = 1024 * 1024 * 1;
 #if PLATFORM_WEBGL
@@ -205,300 +1167,3413 @@ const int kSyntheticDataIterations = 3;
 #else
 const int kSyntheticDataIterations = 9;
 #endif
+static int g_PerfIterations = kSyntheticDataIterations;
+static std::vector<int> g_PerfLengths; // data lengths to test performance on; empty = default set
+static bool g_RunLatency = false; // also do the dependent hash chain (latency) test
+static volatile size_t g_LatencyZero = 0; // see TestLatencyPerLength
+static bool g_PerfCountersEnabled = false; // collect hardware performance counters, where supported
+static PerfCounterGroup g_PerfCounterGroup; // opened when above is set, and counters are available
+
+// "16KB", "4MB", "1GB" etc. for sizes that are whole units, plain bytes otherwise
+static std::string FormatByteSize(size_t size)
+{
+	const char* kUnits[] = { "B", "KB", "MB", "GB", "TB" };
+	int unit = 0;
+	while (unit < 4 && size >= 1024 && (size & 1023) == 0)
+	{
+		size >>= 10;
+		++unit;
+	}
+	char buf[32];
+	snprintf(buf, sizeof(buf), "%llu%s", (unsigned long long)size, kUnits[unit]);
+	return buf;
+}
+
+static void AddDefaultPerfLengths(std::vector<int>& lengths)
+{
+	int step = 2;
+	for (int len = 2; len < 5000; len += step, step += step/2)
+		lengths.push_back(len);
+}
 
 
+// Working set sweep: same kind of test as below, on synthetic data buffers of various sizes, so
+// that input comes from different levels of the cache hierarchy (or memory). Each measurement
+// hashes kWorkingSetBytesPerTest worth of buffer, continuing from where the previous one stopped;
+// so small buffers are hot in cache, and ones much larger than the caches are always cold.
+const size_t kWorkingSetBytesPerTest = 8 * 1024 * 1024;
+static std::vector<size_t> g_WorkingSetSizes; // empty = no working set sweep
+static bool g_WorkingSetHugePages = false; // back working set buffers with 2MB pages, where supported
+
+struct WorkingSetBuffer
+{
+	WorkingSetBuffer() : data(NULL), size(0), mappedSize(0), cursor(0), hugePages(false), transparentHugePages(false) { }
+	~WorkingSetBuffer() { Free(); }
+
+	bool Allocate(size_t size_, bool wantHugePages)
+	{
+		Free();
+		size = size_;
+		cursor = 0;
+		hugePages = transparentHugePages = false;
+#		if PLATFORM_LINUX
+		if (wantHugePages)
+		{
+			// explicit 2MB pages need a reserved hugetlbfs pool; if there is none, ask for transparent huge pages
+			const size_t kHugePageSize = 2 * 1024 * 1024;
+			mappedSize = (size + kHugePageSize - 1) & ~(kHugePageSize - 1);
+			void* ptr = mmap(NULL, mappedSize, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB | (21 << MAP_HUGE_SHIFT), -1, 0);
+			hugePages = ptr != MAP_FAILED;
+			if (!hugePages)
+			{
+				ptr = mmap(NULL, mappedSize, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+				if (ptr == MAP_FAILED)
+					return false;
+				transparentHugePages = madvise(ptr, mappedSize, MADV_HUGEPAGE) == 0;
+			}
+			data = (uint8_t*)ptr;
+		}
+#		endif
+		if (!data)
+		{
+			data = (uint8_t*)malloc(size);
+			if (!data)
+				return false;
+		}
+		for (size_t i = 0; i < size; ++i)
+			data[i] = (uint8_t)i;
+		return true;
+	}
+	void Free()
+	{
+#		if PLATFORM_LINUX
+		if (data && mappedSize)
+			munmap(data, mappedSize);
+		else
+#		endif
+			free(data);
+		data = NULL;
+		mappedSize = 0;
+	}
+
+	uint8_t* data;
+	size_t size;
+	size_t mappedSize; // when mmap'ed
+	size_t cursor; // where the next test continues
+	bool hugePages; // explicit 2MB pages
+	bool transparentHugePages; // kernel was asked to use huge pages; whether it does is up to it
+};
 
-// synthetic hash performance test on various string lengths
 template<typename Hasher>
-void TestPerformancePerLength(const std::vector<uint8_t>& data, bool aligned, Result& outResult)
+void TestWorkingSetPerLength(WorkingSetBuffer& buffer, size_t workingSetIndex, Result& outResult)
 {
 	Hasher hasher;
+	if (outResult.workingSets.size() <= workingSetIndex)
+		outResult.workingSets.resize(workingSetIndex + 1);
+	Result::WorkingSetResult& res = outResult.workingSets[workingSetIndex];
+	res.size = buffer.size;
+	res.mbpsPerLength.resize(g_PerfLengths.size());
 
-	int step = 2;
-	int index = 0;
-	for (int len = 2; len < 5000; len += step, step += step/2, ++index)
+	for (size_t index = 0; index < g_PerfLengths.size(); ++index)
 	{
-		size_t dataLen = data.size();
+		const size_t len = g_PerfLengths[index];
+		size_t lenAligned = (len + 63) & ~63;
+		if (lenAligned == 0)
+			lenAligned = 64;
+		if (lenAligned > buffer.size)
+			continue;
 
-		const uint8_t* dataPtr = data.data();
-		TimerBegin();
-		size_t pos = 0;
-		size_t lenAligned = len;
-		//if (aligned)
-			lenAligned = (lenAligned + 63) & ~63;
+		size_t pos = buffer.cursor;
 		size_t totalBytes = 0;
-		while (pos + len < dataLen)
+		size_t span = 0;
+		TimerBegin();
+		while (span < kWorkingSetBytesPerTest)
 		{
-			outResult.hashsum ^= hasher(dataPtr + pos, len);
+			if (pos + lenAligned > buffer.size)
+				pos = 0;
+			outResult.hashsum ^= hasher(buffer.data + pos, len);
 			pos += lenAligned;
+			span += lenAligned;
 			totalBytes += len;
 		}
 		float sec = TimerEnd();
+		buffer.cursor = pos;
 
-		// MB/s
 		float mbps = (float)((totalBytes / 1024.0 / 1024.0) / sec);
-		if (index < outResult.mbpsPerLength.size())
-		{
-			// if we got higher MB/s, use that (i.e. out of all iterations, we pick fastest one)
-			assert(outResult.mbpsPerLength[index].length == len);
-			if (aligned)
-			{
-				if (mbps > outResult.mbpsPerLength[index].mbpsAligned)
-					outResult.mbpsPerLength[index].mbpsAligned = mbps;
-			}
-			else
-			{
-				if (mbps > outResult.mbpsPerLength[index].mbps)
-					outResult.mbpsPerLength[index].mbps = mbps;
-			}
-		}
-		else
-		{
-			// add result if no previous iterations did it yet
-			Result::PerfResult res;
-			res.length = len;
-			if (aligned)
-				res.mbpsAligned = mbps;
-			else
-				res.mbps = mbps;
-			outResult.mbpsPerLength.push_back(res);
-		}
+		if (mbps > res.mbpsPerLength[index])
+			res.mbpsPerLength[index] = mbps;
 	}
 }
 
 
-// ------------------------------------------------------------------------------------
-// Individual hash functions for use in the testing code above
-
-struct HasherXXH32 : public Hasher32Bit
-{
-	HashType operator()(const void* data, size_t size) const { return XXH32(data, size, 0x1234); }
-};
-struct HasherXXH64_32 : public Hasher32Bit
+// Key mixes: hashing a list of keys of varying lengths, as real world use does; the
+// lengths can't be predicted, so there are branch mispredictions in the hash functions that
+// fixed length tests never see. The lists are entries of each (non streamed) data set, in
+// file order and shuffled (which also makes memory access random), and synthetic keys with
+// Zipf distributed lengths (length k has probability proportional to 1/k^s). Keys are read
+// straight from the entries table; shuffled order is a permutation of entry indices.
+struct KeyMix
 {
-	HashType operator()(const void* data, size_t size) const { return (HashType)XXH64(data, size, 0x1234); }
+	KeyMix() : data(NULL), entries(NULL), keyCount(0), totalBytes(0) { }
+	std::string name;
+	const uint8_t* data;
+	const DataSetEntries* entries;
+	std::vector<uint32_t> order; // entry indices; empty for the first keyCount entries in order
+	size_t keyCount;
+	size_t totalBytes;
 };
-struct HasherXXH64 : public Hasher64Bit
+static std::vector<KeyMix> g_KeyMixes;
+static DataSetEntries g_ZipfKeys; // offsets into synthetic data
+static bool g_RunKeyMix = false;
+static float g_ZipfExponent = 1.0f;
+const int kZipfMaxLength = 256;
+const size_t kZipfKeyCount = 65536;
+const size_t kKeyMixMaxKeys = 4 * 1024 * 1024; // only the first this many entries of a data set are used
+const size_t kKeyMixMinKeys = 256 * 1024; // each measurement repeats the list until this many keys, or bytes, were hashed
+const size_t kKeyMixMinBytes = 4 * 1024 * 1024;
+
+// Used by the hash table tests, which need random access to keys
+struct KeyRef
 {
-	HashType operator()(const void* data, size_t size) const { return XXH64(data, size, 0x1234); }
+	const uint8_t* ptr;
+	size_t length;
 };
 
-struct HasherSpookyV2_64 : public Hasher64Bit
+// first maxKeys entries of a (non streamed) data set, in file order
+static void GetDataSetKeys(const DataSet& data, size_t maxKeys, std::vector<KeyRef>& outKeys)
 {
-	HashType operator()(const void* data, size_t size) const { return SpookyHash::Hash64(data, (int)size, 0x1234); }
-};
+	outKeys.clear();
+	if (data.IsStreamed())
+		return;
+	const uint8_t* fileData = (const uint8_t*)data.fileData;
+	outKeys.reserve(std::min(data.entries.size(), maxKeys));
+	auto addKey = [&](size_t offset, size_t length)
+	{
+		KeyRef key = { fileData + offset, length };
+		outKeys.push_back(key);
+	};
+	data.entries.ForEachFirst(maxKeys, addKey);
+}
 
-struct HasherMurmur2A : public Hasher32Bit
+template<typename Hasher>
+void TestKeyMix(size_t mixIndex, Result& outResult)
 {
-	HashType operator()(const void* data, size_t size) const { return MurmurHash2A(data, (int)size, 0x1234); }
-};
-struct HasherMurmur3_32 : public Hasher32Bit
+	Hasher hasher;
+	const KeyMix& mix = g_KeyMixes[mixIndex];
+	if (outResult.keyMixes.size() < g_KeyMixes.size())
+		outResult.keyMixes.resize(g_KeyMixes.size());
+	const size_t keyCount = mix.keyCount;
+	if (keyCount == 0)
+		return;
+
+	const uint8_t* data = mix.data;
+	size_t totalKeys = 0, totalBytes = 0;
+	uint32_t hashsum = 0;
+	auto hashKey = [&](size_t offset, size_t length)
+	{
+		hashsum ^= (uint32_t)hasher(data + offset, length);
+	};
+	TimerBegin();
+	do
+	{
+		if (mix.order.empty())
+			mix.entries->ForEachFirst(keyCount, hashKey);
+		else
+			mix.entries->ForEachPermuted(mix.order.data(), keyCount, hashKey);
+		totalKeys += keyCount;
+		totalBytes += mix.totalBytes;
+	} while (totalKeys < kKeyMixMinKeys && totalBytes < kKeyMixMinBytes);
+	float sec = TimerEnd();
+	outResult.hashsum ^= hashsum;
+
+	Result::KeyMixResult& res = outResult.keyMixes[mixIndex];
+	float keysPerSec = (float)(totalKeys / sec);
+	if (keysPerSec > res.keysPerSec)
+	{
+		res.keysPerSec = keysPerSec;
+		res.mbps = (float)((totalBytes / 1024.0 / 1024.0) / sec);
+	}
+}
+
+
+// Hash table tests: data set entries in real hash tables, see HashTables.h. Every other entry
+// is inserted; then all inserted ones are looked up (hits), and all the others (misses, unless
+// the data set has duplicate entries). Times include hashing the keys, so this is where hash
+// quality and hash speed meet: ns per lookup.
+// - Open addressing (linear probing) table, sized like in the quality test model: power of
+//   two, with load factor up to 0.8.
+// - Swiss table, up to its usual maximum load factor of 7/8; also tells how often the 7 bit
+//   tags match for other keys.
+// - Robin Hood table, filled up to each of kRobinHoodLoadFactors in turn; at each one, the
+//   probe length distribution of lookups (present & missing keys), and time per operation.
+//   Capacity is the largest power of two that the entries can fill to the highest load factor.
+// - Cuckoo table & cuckoo filter, for 128 bit hash functions: both bucket choices come from one
+//   hash call. Entries are inserted until the table / filter gets full, which tells the load
+//   factor it can reach. Lookups here measure latency: the key of each one depends on the result
+//   of the previous one (see TestLatencyPerLength).
+// - Blocked Bloom filter (kBloomBitsPerKey, kBloomProbeCount), for all hash functions: queries/s
+//   of all entries (present & missing), and false positive rate vs. theory. Bits of a key come
+//   either from k separate (salted & remixed) hash calls, or from double hashing of one call;
+//   queries are done one by one, or in batches that hash all keys first, then prefetch all
+//   blocks, then test.
+const size_t kHashTableMaxKeys = 4 * 1024 * 1024; // only the first this many entries of a data set are used
+const double kHashTableMaxLoadFactor = 0.8;
+const double kSwissTableMaxLoadFactor = 0.875;
+const float kRobinHoodLoadFactors[] = { 0.5f, 0.6f, 0.7f, 0.8f, 0.9f, 0.95f };
+const size_t kRobinHoodLoadFactorCount = sizeof(kRobinHoodLoadFactors) / sizeof(kRobinHoodLoadFactors[0]);
+const size_t kRobinHoodMinCapacity = 64;
+static bool g_RunHashTable = false;
+static bool g_RunSwissTable = false;
+static bool g_RunRobinHood = false;
+static bool g_RunCuckoo = false;
+static bool g_RunBloom = false;
+static std::vector<std::vector<KeyRef> > g_DataSetKeys; // per data set, when hash table tests are done; empty for streamed ones
+
+// best of all iterations: the lowest value; 0 until the first one
+static void KeepMin(float& best, float value)
 {
-	HashType operator()(const void* data, size_t size) const { HashType res; MurmurHash3_x86_32(data, (int)size, 0x1234, &res); return res; }
-};
-struct HasherMurmur3_x64_128 : public Hasher64Bit
+	if (best == 0 || value < best)
+		best = value;
+}
+
+struct KeyRefEqual
 {
-	HashType operator()(const void* data, size_t size) const { HashType res[2]; MurmurHash3_x64_128(data, (int)size, 0x1234, &res); return res[0]; }
+	KeyRefEqual(const std::vector<KeyRef>& keys) : keys(keys.data()), key(NULL) { }
+	bool operator()(uint32_t index) const { return keys[index].length == key->length && memcmp(keys[index].ptr, key->ptr, key->length) == 0; }
+	const KeyRef* keys;
+	const KeyRef* key; // the one being inserted / looked up
 };
 
-struct HasherMum_32 : public Hasher32Bit
+template<typename Hasher>
+void TestLinearProbingTable(size_t dataIndex, Result& outResult)
 {
-	HashType operator()(const void* data, size_t size) const { return (uint32_t)mum_hash(data, size, 0x1234); }
-};
-struct HasherMum : public Hasher64Bit
+	typedef typename Hasher::HashType HashType;
+	Hasher hasher;
+	if (outResult.hashTables.size() < g_DataSetKeys.size())
+		outResult.hashTables.resize(g_DataSetKeys.size());
+	const std::vector<KeyRef>& keys = g_DataSetKeys[dataIndex];
+	const size_t keyCount = keys.size();
+	if (keyCount < 2)
+		return;
+
+	LinearProbingTable<HashType> table;
+	table.Reset(NextPowerOfTwo((uint32_t)(((keyCount + 1) / 2) / kHashTableMaxLoadFactor)));
+	KeyRefEqual equal(keys);
+	size_t probes, insertProbes = 0, hitProbes = 0, hitMaxProbes = 0, missProbes = 0, missMaxProbes = 0;
+	uint32_t hashsum = 0;
+
+	TimerBegin();
+	for (size_t i = 0; i < keyCount; i += 2)
+	{
+		equal.key = &keys[i];
+		hashsum ^= table.Insert(hasher(equal.key->ptr, equal.key->length), (uint32_t)i, equal, probes);
+		insertProbes += probes;
+	}
+	float insertSec = TimerEnd();
+	TimerBegin();
+	for (size_t i = 0; i < keyCount; i += 2)
+	{
+		equal.key = &keys[i];
+		hashsum ^= table.Find(hasher(equal.key->ptr, equal.key->length), equal, probes);
+		hitProbes += probes;
+		hitMaxProbes = std::max(hitMaxProbes, probes);
+	}
+	float hitSec = TimerEnd();
+	TimerBegin();
+	for (size_t i = 1; i < keyCount; i += 2)
+	{
+		equal.key = &keys[i];
+		hashsum ^= table.Find(hasher(equal.key->ptr, equal.key->length), equal, probes);
+		missProbes += probes;
+		missMaxProbes = std::max(missMaxProbes, probes);
+	}
+	float missSec = TimerEnd();
+	outResult.hashsum ^= hashsum;
+
+	const size_t insertCount = (keyCount + 1) / 2, missCount = keyCount / 2;
+	Result::HashTableResult& res = outResult.hashTables[dataIndex];
+	res.loadFactor = (float)table.GetLoadFactor();
+	res.insertProbesAvg = (float)insertProbes / insertCount;
+	res.hitProbesAvg = (float)hitProbes / insertCount;
+	res.hitProbesMax = (int)hitMaxProbes;
+	res.missProbesAvg = (float)missProbes / missCount;
+	res.missProbesMax = (int)missMaxProbes;
+	const float insertNs = insertSec * 1.0e9f / insertCount;
+	const float hitNs = hitSec * 1.0e9f / insertCount;
+	const float missNs = missSec * 1.0e9f / missCount;
+	KeepMin(res.insertNs, insertNs);
+	KeepMin(res.hitNs, hitNs);
+	KeepMin(res.missNs, missNs);
+}
+
+template<typename Hasher>
+void TestSwissTable(size_t dataIndex, Result& outResult)
 {
-	HashType operator()(const void* data, size_t size) const { return mum_hash(data, size, 0x1234); }
-};
+	typedef typename Hasher::HashType HashType;
+	Hasher hasher;
+	if (outResult.swissTables.size() < g_DataSetKeys.size())
+		outResult.swissTables.resize(g_DataSetKeys.size());
+	const std::vector<KeyRef>& keys = g_DataSetKeys[dataIndex];
+	const size_t keyCount = keys.size();
+	if (keyCount < 2)
+		return;
 
-struct HasherCity32 : public Hasher32Bit
+	SwissTable<HashType> table;
+	table.Reset((size_t)(((keyCount + 1) / 2) / kSwissTableMaxLoadFactor) + 1);
+	KeyRefEqual equal(keys);
+	SwissTableStats insertStats, hitStats, missStats;
+	uint32_t hashsum = 0;
+
+	TimerBegin();
+	for (size_t i = 0; i < keyCount; i += 2)
+	{
+		equal.key = &keys[i];
+		hashsum ^= table.Insert(hasher(equal.key->ptr, equal.key->length), (uint32_t)i, equal, insertStats);
+	}
+	float insertSec = TimerEnd();
+	TimerBegin();
+	for (size_t i = 0; i < keyCount; i += 2)
+	{
+		equal.key = &keys[i];
+		hashsum ^= table.Find(hasher(equal.key->ptr, equal.key->length), equal, hitStats);
+	}
+	float hitSec = TimerEnd();
+	TimerBegin();
+	for (size_t i = 1; i < keyCount; i += 2)
+	{
+		equal.key = &keys[i];
+		hashsum ^= table.Find(hasher(equal.key->ptr, equal.key->length), equal, missStats);
+	}
+	float missSec = TimerEnd();
+	outResult.hashsum ^= hashsum;
+
+	const size_t insertCount = (keyCount + 1) / 2, missCount = keyCount / 2;
+	const size_t comparedSlots = hitStats.fullSlots + missStats.fullSlots;
+	const size_t falseMatches = hitStats.falseMatches + missStats.falseMatches;
+	Result::SwissTableResult& res = outResult.swissTables[dataIndex];
+	res.loadFactor = (float)table.GetLoadFactor();
+	res.hitGroupsAvg = (float)hitStats.groups / insertCount;
+	res.missGroupsAvg = (float)missStats.groups / missCount;
+	res.falseMatchesPerLookup = (float)falseMatches / (insertCount + missCount);
+	res.falseMatchRate = comparedSlots ? (float)(falseMatches * 100.0 / comparedSlots) : 0.0f;
+	const float insertNs = insertSec * 1.0e9f / insertCount;
+	const float hitNs = hitSec * 1.0e9f / insertCount;
+	const float missNs = missSec * 1.0e9f / missCount;
+	KeepMin(res.insertNs, insertNs);
+	KeepMin(res.hitNs, hitNs);
+	KeepMin(res.missNs, missNs);
+}
+
+// table capacity for the Robin Hood test, 0 if there are not enough entries
+static size_t GetRobinHoodCapacity(size_t keyCount)
 {
-	HashType operator()(const void* data, size_t size) const { return CityHash32((const char*)data, size); }
-};
-struct HasherCity64_32 : public Hasher32Bit
+	const size_t insertCount = (keyCount + 1) / 2;
+	const float maxLoadFactor = kRobinHoodLoadFactors[kRobinHoodLoadFactorCount - 1];
+	size_t capacity = kRobinHoodMinCapacity;
+	if (capacity * maxLoadFactor > insertCount)
+		return 0;
+	while (capacity * 2 * maxLoadFactor <= insertCount)
+		capacity *= 2;
+	return capacity;
+}
+
+template<typename Hasher>
+void TestRobinHoodTable(size_t dataIndex, Result& outResult)
 {
-	HashType operator()(const void* data, size_t size) const { return (uint32_t)CityHash64((const char*)data, size); }
-};
-struct HasherCity64 : public Hasher64Bit
+	typedef typename Hasher::HashType HashType;
+	Hasher hasher;
+	if (outResult.robinHood.size() < g_DataSetKeys.size())
+		outResult.robinHood.resize(g_DataSetKeys.size());
+	const std::vector<KeyRef>& keys = g_DataSetKeys[dataIndex];
+	const size_t keyCount = keys.size();
+	const size_t capacity = GetRobinHoodCapacity(keyCount);
+	if (capacity == 0)
+		return;
+	std::vector<Result::RobinHoodResult>& results = outResult.robinHood[dataIndex];
+	results.resize(kRobinHoodLoadFactorCount);
+
+	RobinHoodTable<HashType> table;
+	table.Reset(capacity);
+	KeyRefEqual equal(keys);
+	size_t probes, next = 0; // next (even) entry to insert
+	uint32_t hashsum = 0;
+	for (size_t il = 0; il < kRobinHoodLoadFactorCount; ++il)
+	{
+		// fill up to this load factor
+		const size_t targetSize = (size_t)(kRobinHoodLoadFactors[il] * capacity);
+		const size_t insertStart = next;
+		TimerBegin();
+		for (; table.GetSize() < targetSize && next < keyCount; next += 2)
+		{
+			equal.key = &keys[next];
+			hashsum ^= table.Insert(hasher(equal.key->ptr, equal.key->length), (uint32_t)next, equal, probes);
+		}
+		float insertSec = TimerEnd();
+		if (table.GetSize() < targetSize)
+			break; // not enough distinct entries
+		const size_t insertCount = (next - insertStart) / 2;
+
+		// look up everything inserted so far, and as many missing entries
+		const size_t hitCount = next / 2;
+		TimerBegin();
+		for (size_t i = 0; i < next; i += 2)
+		{
+			equal.key = &keys[i];
+			hashsum ^= table.Find(hasher(equal.key->ptr, equal.key->length), equal, probes);
+		}
+		float hitSec = TimerEnd();
+		size_t missCount = 0;
+		TimerBegin();
+		for (size_t i = 1; i < keyCount && i <= next; i += 2, ++missCount)
+		{
+			equal.key = &keys[i];
+			hashsum ^= table.Find(hasher(equal.key->ptr, equal.key->length), equal, probes);
+		}
+		float missSec = TimerEnd();
+
+		// probe length distributions, outside of timing: hits from the table itself, misses by looking them up again
+		ProbeHistogram hitHistogram, missHistogram;
+		table.GetProbeHistogram(hitHistogram);
+		for (size_t i = 1; i < keyCount && i <= next; i += 2)
+		{
+			equal.key = &keys[i];
+			table.Find(hasher(equal.key->ptr, equal.key->length), equal, probes);
+			missHistogram.Add(probes);
+		}
+
+		Result::RobinHoodResult& res = results[il];
+		res.loadFactor = (float)table.GetLoadFactor();
+		res.hitProbesMean = (float)hitHistogram.GetMean();
+		res.hitProbesP99 = (int)hitHistogram.GetPercentile(0.99);
+		res.hitProbesMax = (int)hitHistogram.GetMax();
+		res.missProbesMean = (float)missHistogram.GetMean();
+		res.missProbesP99 = (int)missHistogram.GetPercentile(0.99);
+		res.missProbesMax = (int)missHistogram.GetMax();
+		const float insertNs = insertCount ? insertSec * 1.0e9f / insertCount : 0.0f;
+		const float hitNs = hitSec * 1.0e9f / hitCount;
+		const float missNs = missCount ? missSec * 1.0e9f / missCount : 0.0f;
+		KeepMin(res.insertNs, insertNs);
+		KeepMin(res.hitNs, hitNs);
+		KeepMin(res.missNs, missNs);
+	}
+	outResult.hashsum ^= hashsum;
+}
+
+// Both 64 bit halves of a 128 bit hash function result
+struct Hash128Value
 {
-	HashType operator()(const void* data, size_t size) const { return CityHash64((const char*)data, size); }
+	uint64_t low, high;
 };
 
-struct HasherFarm32 : public Hasher32Bit
+// Results of 128 bit hash functions; only cuckoo & Bloom filter tests for now
+struct Result128
 {
-	HashType operator()(const void* data, size_t size) const { return util::Hash32((const char*)data, size); }
+	struct CuckooTableResult
+	{
+		CuckooTableResult() : loadFactor(0), insertNs(0), hitNs(0), missNs(0), kicksMean(0), kicksMax(0) { }
+		float loadFactor; // when it got full, or when out of entries
+		float insertNs; // per insert, best of all iterations
+		float hitNs, missNs; // lookup latency, best of all iterations
+		float kicksMean; // keys moved per insert that succeeded (like kicksMax, leaves out the one that failed)
+		int kicksMax; // longest kick chain of an insert that succeeded
+	};
+	struct CuckooFilterResult : public CuckooTableResult
+	{
+		CuckooFilterResult() : falsePositiveRate(0), expectedFalsePositiveRate(0) { }
+		float falsePositiveRate; // % of lookups of missing entries
+		float expectedFalsePositiveRate; // % for the filter's load factor & fingerprint size
+	};
+
+	Result128() : hashsum(0) { }
+	std::string name;
+	std::vector<CuckooTableResult> cuckooTables; // same order as g_DataSets
+	std::vector<CuckooFilterResult> cuckooFilters;
+	std::vector<Result::BloomFilterResult> bloomFilters;
+	uint32_t hashsum;
 };
-struct HasherFarm64_32 : public Hasher32Bit
+
+// table / filter capacity for the cuckoo tests, 0 if there are not enough entries: largest
+// power of two that the inserted entries can fill completely
+const size_t kCuckooMinCapacity = 64;
+
+static size_t GetCuckooCapacity(size_t keyCount)
 {
-	HashType operator()(const void* data, size_t size) const { return (uint32_t)util::Hash64((const char*)data, size); }
-};
-struct HasherFarm64 : public Hasher64Bit
+	const size_t insertCount = (keyCount + 1) / 2;
+	size_t capacity = kCuckooMinCapacity;
+	if (capacity > insertCount)
+		return 0;
+	while (capacity * 2 <= insertCount)
+		capacity *= 2;
+	return capacity;
+}
+
+// Ground truth for filter false positive rates: entries that were not inserted (odd ones, up to
+// insertEnd) only count as missing if they are not duplicates of inserted ones (even ones before
+// insertEnd). Checked exactly with a hash table of the inserted entries, outside of timing; getHash
+// gives the 64 bit table hash of an entry. Calls onMissing for every missing entry, returns their count.
+template<typename GetHash, typename OnMissing>
+static size_t ForEachMissingKey(const std::vector<KeyRef>& keys, size_t insertEnd, const GetHash& getHash, const OnMissing& onMissing)
 {
-	HashType operator()(const void* data, size_t size) const { return util::Hash64((const char*)data, size); }
-};
+	const size_t keyCount = keys.size();
+	LinearProbingTable<uint64_t> inserted;
+	inserted.Reset(NextPowerOfTwo((uint32_t)(((insertEnd + 1) / 2) / kHashTableMaxLoadFactor)));
+	KeyRefEqual equal(keys);
+	size_t probes, missCount = 0;
+	for (size_t i = 0; i < insertEnd; i += 2)
+	{
+		equal.key = &keys[i];
+		inserted.Insert(getHash(keys[i]), (uint32_t)i, equal, probes);
+	}
+	for (size_t i = 1; i < keyCount && i <= insertEnd; i += 2)
+	{
+		equal.key = &keys[i];
+		if (inserted.Find(getHash(keys[i]), equal, probes) != LinearProbingTable<uint64_t>::kEmpty)
+			continue;
+		++missCount;
+		onMissing(keys[i]);
+	}
+	return missCount;
+}
 
-// Reference SipHash implementation, https://github.com/veorq/SipHash
-static const uint8_t kSipHashKey[16] = {0x75,0x4E,0x3F,0x38, 0x21,0x0A,0xFE,0x71, 0x9D,0xDC,0x54,0x72, 0x09,0x1A,0xD4,0x79};
-struct HasherSipRef_32 : public Hasher32Bit
+template<typename Hasher128>
+void TestCuckooTable(size_t dataIndex, Result128& outResult)
 {
-	HashType operator()(const void* data, size_t size) const { uint64_t res; siphash((uint8_t*)&res, (const uint8_t*)data, size, kSipHashKey); return (HashType)res; }
-};
-struct HasherSipRef : public Hasher64Bit
+	Hasher128 hasher;
+	const std::vector<KeyRef>& keys = g_DataSetKeys[dataIndex];
+	const size_t keyCount = keys.size();
+	CuckooTable table;
+	table.Reset(GetCuckooCapacity(keyCount));
+	KeyRefEqual equal(keys);
+	const size_t zero = g_LatencyZero;
+	size_t kicks, kicksSum = 0, kicksMax = 0, succeeded = 0, next = 0; // next (even) entry to insert
+	uint32_t found = 0, hashsum = 0;
+
+	TimerBegin();
+	for (; next < keyCount && !table.IsFull(); next += 2)
+	{
+		equal.key = &keys[next];
+		Hash128Value h = hasher(equal.key->ptr, equal.key->length);
+		if (table.Insert(h.low, h.high, (uint32_t)next, equal, kicks))
+		{
+			kicksSum += kicks;
+			kicksMax = std::max(kicksMax, kicks);
+			++succeeded;
+		}
+	}
+	float insertSec = TimerEnd();
+	const size_t insertCount = next / 2;
+	TimerBegin();
+	for (size_t i = 0; i < next; i += 2)
+	{
+		equal.key = &keys[i + (found & zero)];
+		Hash128Value h = hasher(equal.key->ptr, equal.key->length);
+		found = table.Find(h.low, h.high, equal);
+		hashsum ^= found;
+	}
+	float hitSec = TimerEnd();
+	size_t missCount = 0;
+	TimerBegin();
+	for (size_t i = 1; i < keyCount && i <= next; i += 2, ++missCount)
+	{
+		equal.key = &keys[i + (found & zero)];
+		Hash128Value h = hasher(equal.key->ptr, equal.key->length);
+		found = table.Find(h.low, h.high, equal);
+		hashsum ^= found;
+	}
+	float missSec = TimerEnd();
+	outResult.hashsum ^= hashsum;
+
+	Result128::CuckooTableResult& res = outResult.cuckooTables[dataIndex];
+	res.loadFactor = (float)table.GetLoadFactor();
+	res.kicksMean = succeeded ? (float)kicksSum / succeeded : 0.0f;
+	res.kicksMax = (int)kicksMax;
+	const float insertNs = insertSec * 1.0e9f / insertCount;
+	const float hitNs = hitSec * 1.0e9f / insertCount;
+	const float missNs = missCount ? missSec * 1.0e9f / missCount : 0.0f;
+	KeepMin(res.insertNs, insertNs);
+	KeepMin(res.hitNs, hitNs);
+	KeepMin(res.missNs, missNs);
+}
+
+template<typename Hasher128>
+void TestCuckooFilter(size_t dataIndex, Result128& outResult)
 {
-	HashType operator()(const void* data, size_t size) const { uint64_t res; siphash((uint8_t*)&res, (const uint8_t*)data, size, kSipHashKey); return res; }
-};
+	Hasher128 hasher;
+	const std::vector<KeyRef>& keys = g_DataSetKeys[dataIndex];
+	const size_t keyCount = keys.size();
+	CuckooFilter filter;
+	filter.Reset(GetCuckooCapacity(keyCount));
+	const size_t zero = g_LatencyZero;
+	size_t kicks, kicksSum = 0, kicksMax = 0, succeeded = 0, next = 0; // next (even) entry to insert
+	size_t found = 0, positives = 0;
+
+	TimerBegin();
+	for (; next < keyCount && !filter.IsFull(); next += 2)
+	{
+		const KeyRef& key = keys[next];
+		Hash128Value h = hasher(key.ptr, key.length);
+		if (filter.Insert(h.low, h.high, kicks))
+		{
+			kicksSum += kicks;
+			kicksMax = std::max(kicksMax, kicks);
+			++succeeded;
+		}
+	}
+	float insertSec = TimerEnd();
+	const size_t insertCount = next / 2;
+	TimerBegin();
+	for (size_t i = 0; i < next; i += 2)
+	{
+		const KeyRef& key = keys[i + (found & zero)];
+		Hash128Value h = hasher(key.ptr, key.length);
+		found = filter.Contains(h.low, h.high);
+		positives += found;
+	}
+	float hitSec = TimerEnd();
+	size_t missCount = 0;
+	TimerBegin();
+	for (size_t i = 1; i < keyCount && i <= next; i += 2, ++missCount)
+	{
+		const KeyRef& key = keys[i + (found & zero)];
+		Hash128Value h = hasher(key.ptr, key.length);
+		found = filter.Contains(h.low, h.high);
+		positives += found;
+	}
+	float missSec = TimerEnd();
+	outResult.hashsum ^= (uint32_t)positives;
+
+	// false positives: missing entries reported as present
+	size_t falsePositives = 0;
+	auto getHash = [&](const KeyRef& key) { return hasher(key.ptr, key.length).low; };
+	auto countFalsePositive = [&](const KeyRef& key)
+	{
+		Hash128Value h = hasher(key.ptr, key.length);
+		falsePositives += filter.Contains(h.low, h.high);
+	};
+	const size_t fpMissCount = ForEachMissingKey(keys, next, getHash, countFalsePositive);
+
+	Result128::CuckooFilterResult& res = outResult.cuckooFilters[dataIndex];
+	res.loadFactor = (float)filter.GetLoadFactor();
+	res.kicksMean = succeeded ? (float)kicksSum / succeeded : 0.0f;
+	res.kicksMax = (int)kicksMax;
+	res.falsePositiveRate = fpMissCount ? (float)(falsePositives * 100.0 / fpMissCount) : 0.0f;
+	res.expectedFalsePositiveRate = (float)(filter.GetExpectedFalsePositiveRate() * 100.0);
+	const float insertNs = insertSec * 1.0e9f / insertCount;
+	const float hitNs = hitSec * 1.0e9f / insertCount;
+	const float missNs = missCount ? missSec * 1.0e9f / missCount : 0.0f;
+	KeepMin(res.insertNs, insertNs);
+	KeepMin(res.hitNs, hitNs);
+	KeepMin(res.missNs, missNs);
+}
+
+template<typename Hasher128>
+void TestCuckoo(size_t dataIndex, Result128& outResult)
+{
+	if (outResult.cuckooTables.size() < g_DataSetKeys.size())
+	{
+		outResult.cuckooTables.resize(g_DataSetKeys.size());
+		outResult.cuckooFilters.resize(g_DataSetKeys.size());
+	}
+	if (GetCuckooCapacity(g_DataSetKeys[dataIndex].size()) == 0)
+		return;
+	TestCuckooTable<Hasher128>(dataIndex, outResult);
+	TestCuckooFilter<Hasher128>(dataIndex, outResult);
+}
+
+const size_t kBloomBitsPerKey = 10;
+const int kBloomProbeCount = 7; // optimal for 10 bits/key: 10 * ln 2
+const size_t kBloomBatchSize = 32;
+
+// From one hash: 32 bits that pick the Bloom filter block, and a, b for double hashing. A 32 bit
+// hash has to be stretched for that, so its bits are not independent; a 64 bit one gives a, and
+// b gets remixed from the block bits; a 128 bit one has enough bits for all three.
+struct BloomHashWords
+{
+	uint32_t block, a, b;
+};
+static BloomHashWords GetBloomHashWords(uint32_t h) { BloomHashWords w = { h, h * 0x9E3779B9u, h * 0x85EBCA6Bu }; return w; }
+static BloomHashWords GetBloomHashWords(uint64_t h) { BloomHashWords w = { (uint32_t)(h >> 32), (uint32_t)h, (uint32_t)(h >> 32) * 0x9E3779B9u }; return w; }
+static BloomHashWords GetBloomHashWords(const Hash128Value& h) { BloomHashWords w = { (uint32_t)(h.high >> 32), (uint32_t)h.low, (uint32_t)(h.low >> 32) }; return w; }
+
+// queries all keys, one by one or in batches; returns seconds taken, and how many were found
+template<typename MakeQuery>
+static float TimeBloomQueries(const BlockedBloomFilter& filter, const std::vector<KeyRef>& keys, const MakeQuery& makeQuery, bool batched, size_t& outFound)
+{
+	BloomQuery queries[kBloomBatchSize];
+	bool found[kBloomBatchSize];
+	const size_t keyCount = keys.size();
+	outFound = 0;
+	TimerBegin();
+	if (batched)
+	{
+		for (size_t i = 0; i < keyCount; i += kBloomBatchSize)
+		{
+			const size_t count = std::min(kBloomBatchSize, keyCount - i);
+			for (size_t j = 0; j < count; ++j)
+				makeQuery(keys[i + j], queries[j]);
+			outFound += filter.ContainsBatch(queries, count, found);
+		}
+	}
+	else
+	{
+		for (size_t i = 0; i < keyCount; ++i)
+		{
+			makeQuery(keys[i], queries[0]);
+			outFound += filter.Contains(queries[0]);
+		}
+	}
+	return TimerEnd();
+}
+
+template<typename Hasher, typename HashValue>
+void TestBloomFilterWith(size_t dataIndex, std::vector<Result::BloomFilterResult>& outResults, uint32_t& outHashsum)
+{
+	Hasher hasher;
+	const std::vector<KeyRef>& keys = g_DataSetKeys[dataIndex];
+	const size_t keyCount = keys.size();
+	if (outResults.size() < g_DataSetKeys.size())
+		outResults.resize(g_DataSetKeys.size());
+	if (keyCount < 2)
+		return;
+	const size_t insertCount = (keyCount + 1) / 2;
+
+	// k separate hashes of a key: hash the key prefixed with a different random 8 byte salt block
+	// each time, and remix the result (for hash functions that are not a keyed family, salted results
+	// are simple functions of each other; e.g. with FNV-1a or djb2 the bits of the k hashes would be
+	// strongly correlated, and the false positive rate would show that rather than hash quality).
+	// Block comes from the first. The key is copied once per query into a scratch buffer after the
+	// salt; only the salt is rewritten for each of the k calls, so each call hashes key length + 8 bytes.
+	size_t maxLength = 0;
+	for (size_t i = 0; i < keyCount; ++i)
+		maxLength = std::max(maxLength, keys[i].length);
+	uint64_t salts[kBloomProbeCount];
+	uint64_t saltRng = 0;
+	for (int i = 0; i < kBloomProbeCount; ++i)
+		salts[i] = SplitMix64(saltRng);
+	std::vector<uint8_t> salted(maxLength + sizeof(uint64_t));
+	auto separateQuery = [&](const KeyRef& key, BloomQuery& q)
+	{
+		memcpy(&salted[8], key.ptr, key.length);
+		for (int i = 0; i < kBloomProbeCount; ++i)
+		{
+			memcpy(&salted[0], &salts[i], sizeof(salts[i]));
+			BloomHashWords w = GetBloomHashWords(hasher(&salted[0], key.length + 8));
+			uint64_t mixState = ((uint64_t)w.block << 32) ^ w.a;
+			const uint64_t mixed = SplitMix64(mixState);
+			if (i == 0)
+				q.blockHash = (uint32_t)(mixed >> 32);
+			q.bits[i] = (uint16_t)((uint32_t)mixed >> 23);
+		}
+	};
+	BlockedBloomFilter separateFilter, doubleFilter;
+	separateFilter.Reset(insertCount * kBloomBitsPerKey, kBloomProbeCount);
+	doubleFilter.Reset(insertCount * kBloomBitsPerKey, kBloomProbeCount);
+	auto doubleQuery = [&](const KeyRef& key, BloomQuery& q)
+	{
+		HashValue h = hasher(key.ptr, key.length);
+		BloomHashWords w = GetBloomHashWords(h);
+		doubleFilter.GetDoubleHashQuery(w.block, w.a, w.b, q);
+	};
+
+	BloomQuery query;
+	for (size_t i = 0; i < keyCount; i += 2)
+	{
+		separateQuery(keys[i], query);
+		separateFilter.Insert(query);
+		doubleQuery(keys[i], query);
+		doubleFilter.Insert(query);
+	}
+
+	size_t found[4];
+	const float separateSec = TimeBloomQueries(separateFilter, keys, separateQuery, false, found[0]);
+	const float separateBatchSec = TimeBloomQueries(separateFilter, keys, separateQuery, true, found[1]);
+	const float doubleSec = TimeBloomQueries(doubleFilter, keys, doubleQuery, false, found[2]);
+	const float doubleBatchSec = TimeBloomQueries(doubleFilter, keys, doubleQuery, true, found[3]);
+	if (found[0] != found[1] || found[2] != found[3])
+		fprintf(g_OutputFile, "error: Bloom filter batched queries gave different results\n");
+	outHashsum ^= (uint32_t)(found[0] * 31 + found[2]);
+
+	// false positives: missing entries reported as present
+	size_t separateFalsePositives = 0, doubleFalsePositives = 0;
+	auto getHash = [&](const KeyRef& key)
+	{
+		BloomHashWords w = GetBloomHashWords(hasher(key.ptr, key.length));
+		return ((uint64_t)w.block << 32) | w.a;
+	};
+	auto countFalsePositive = [&](const KeyRef& key)
+	{
+		separateQuery(key, query);
+		separateFalsePositives += separateFilter.Contains(query);
+		doubleQuery(key, query);
+		doubleFalsePositives += doubleFilter.Contains(query);
+	};
+	const size_t missCount = ForEachMissingKey(keys, keyCount, getHash, countFalsePositive);
+
+	Result::BloomFilterResult& res = outResults[dataIndex];
+	res.separateFalsePositiveRate = missCount ? (float)(separateFalsePositives * 100.0 / missCount) : 0.0f;
+	res.doubleFalsePositiveRate = missCount ? (float)(doubleFalsePositives * 100.0 / missCount) : 0.0f;
+	res.expectedFalsePositiveRate = (float)(doubleFilter.GetExpectedFalsePositiveRate(insertCount) * 100.0);
+	res.separateQps = std::max(res.separateQps, (float)(keyCount / separateSec));
+	res.separateBatchQps = std::max(res.separateBatchQps, (float)(keyCount / separateBatchSec));
+	res.doubleQps = std::max(res.doubleQps, (float)(keyCount / doubleSec));
+	res.doubleBatchQps = std::max(res.doubleBatchQps, (float)(keyCount / doubleBatchSec));
+}
+
+template<typename Hasher>
+void TestBloomFilter(size_t dataIndex, Result& outResult)
+{
+	TestBloomFilterWith<Hasher, typename Hasher::HashType>(dataIndex, outResult.bloomFilters, outResult.hashsum);
+}
+
+template<typename Hasher128>
+void TestBloomFilter128(size_t dataIndex, Result128& outResult)
+{
+	TestBloomFilterWith<Hasher128, Hash128Value>(dataIndex, outResult.bloomFilters, outResult.hashsum);
+}
+
+template<typename Hasher>
+void TestHashTables(size_t dataIndex, Result& outResult)
+{
+	if (g_RunHashTable)
+		TestLinearProbingTable<Hasher>(dataIndex, outResult);
+	if (g_RunSwissTable)
+		TestSwissTable<Hasher>(dataIndex, outResult);
+	if (g_RunRobinHood)
+		TestRobinHoodTable<Hasher>(dataIndex, outResult);
+}
+
+
+// Misalignment sweep: every key starts at the same offset (0..63) from a cache line start,
+// or (kOffsetPageStraddle) keys are placed across 4KB page boundaries, one per page.
+// Measured in whole passes over the synthetic data, until enough hashes/bytes were done.
+const int kOffsetPageStraddle = -1;
+const int kOffsetCount = 65; // 64 cache line offsets + page straddling
+const size_t kOffsetMinHashes = 16384;
+const size_t kOffsetMinBytes = 1024 * 1024;
+const size_t kPageSize = 4096;
+static_assert(PageAlignedAllocator<uint8_t>::kAlignment % kPageSize == 0, "offsets are measured from the synthetic data start");
+static bool g_RunOffsetSweep = false;
+
+static int GetOffsetSweepOffset(size_t index) { return index < 64 ? (int)index : kOffsetPageStraddle; }
+
+template<typename Hasher>
+void TestOffsetsPerLength(const SyntheticData& data, Result& outResult)
+{
+	Hasher hasher;
+	outResult.offsets.resize(kOffsetCount);
+	const uint8_t* dataPtr = data.data(); // page aligned
+	const size_t dataLen = data.size();
+
+	for (size_t io = 0; io < kOffsetCount; ++io)
+	{
+		Result::OffsetResult& res = outResult.offsets[io];
+		res.offset = GetOffsetSweepOffset(io);
+		res.mbpsPerLength.resize(g_PerfLengths.size());
+		for (size_t index = 0; index < g_PerfLengths.size(); ++index)
+		{
+			const size_t len = g_PerfLengths[index];
+			size_t start, stride;
+			if (res.offset == kOffsetPageStraddle)
+			{
+				if (len < 2)
+					continue;
+				stride = (len + kPageSize - 1) / kPageSize * kPageSize + kPageSize;
+				start = kPageSize - len / 2;
+			}
+			else
+			{
+				stride = len ? (len + 63) & ~63 : 64;
+				start = res.offset;
+			}
+			if (start + len > dataLen)
+				continue;
+
+			size_t totalBytes = 0, totalHashes = 0;
+			TimerBegin();
+			do
+			{
+				for (size_t pos = start; pos + len <= dataLen; pos += stride)
+				{
+					outResult.hashsum ^= hasher(dataPtr + pos, len);
+					totalBytes += len;
+					++totalHashes;
+				}
+			} while (totalHashes < kOffsetMinHashes && totalBytes < kOffsetMinBytes);
+			float sec = TimerEnd();
+
+			float mbps = (float)((totalBytes / 1024.0 / 1024.0) / sec);
+			if (mbps > res.mbpsPerLength[index])
+				res.mbpsPerLength[index] = mbps;
+		}
+	}
+}
+
+
+// Multi threaded scaling: 1..N threads, each pinned to its own CPU and hashing its own buffer
+// (allocated & filled by that thread, so it's in its local NUMA node), all at the same time.
+// Each thread does the same test as the working set sweep; aggregate MB/s is all bytes hashed
+// over the time the slowest thread took. Shows which hash functions stay compute bound, and
+// which run into shared memory bandwidth / L3 limits as threads are added.
+#if TASK_SCHEDULER_THREADS
+#	define SCALING_TEST 1
+#endif
+static int g_ScalingMaxThreads = -1; // -1 = no scaling test; 0 = all CPUs
+static bool g_ScalingSmtSiblingsFirst = false; // fill all hardware threads of a core before the next core
+static size_t g_ScalingBufferSize = 16 * 1024 * 1024; // per thread
+
+#if SCALING_TEST
+// all threads wait until the last one arrives
+class ThreadBarrier
+{
+public:
+	explicit ThreadBarrier(int count) : m_Count(count), m_Waiting(0), m_Generation(0) { }
+	void Wait()
+	{
+		std::unique_lock<std::mutex> lock(m_Mutex);
+		int generation = m_Generation;
+		if (++m_Waiting == m_Count)
+		{
+			m_Waiting = 0;
+			++m_Generation;
+			m_Cond.notify_all();
+			return;
+		}
+		m_Cond.wait(lock, [&] { return generation != m_Generation; });
+	}
+private:
+	std::mutex m_Mutex;
+	std::condition_variable m_Cond;
+	int m_Count, m_Waiting, m_Generation;
+};
+
+struct ScalingThread
+{
+	int cpu; // -1 = not pinned, i.e. on any CPU the process was started with
+	WorkingSetBuffer* buffer;
+	ThreadBarrier* barrier;
+	std::vector<size_t> bytesPerLength;
+	std::vector<double> secondsPerLength;
+	uint32_t hashsum;
+};
+
+template<typename Hasher>
+void ScalingThreadLoop(ScalingThread* t)
+{
+	SetAffinity(t->cpu); // also when unpinned: don't inherit the pinning of the perf test thread
+	Hasher hasher;
+	WorkingSetBuffer& buffer = *t->buffer;
+	t->bytesPerLength.assign(g_PerfLengths.size(), 0);
+	t->secondsPerLength.assign(g_PerfLengths.size(), 0);
+	for (size_t index = 0; index < g_PerfLengths.size(); ++index)
+	{
+		const size_t len = g_PerfLengths[index];
+		size_t lenAligned = len ? (len + 63) & ~63 : 64;
+		t->barrier->Wait();
+		if (lenAligned > buffer.size)
+			continue;
+		size_t pos = buffer.cursor, span = 0, totalBytes = 0;
+		std::chrono::steady_clock::time_point t0 = std::chrono::steady_clock::now();
+		while (span < kWorkingSetBytesPerTest)
+		{
+			if (pos + lenAligned > buffer.size)
+				pos = 0;
+			t->hashsum ^= hasher(buffer.data + pos, len);
+			pos += lenAligned;
+			span += lenAligned;
+			totalBytes += len;
+		}
+		std::chrono::steady_clock::time_point t1 = std::chrono::steady_clock::now();
+		buffer.cursor = pos;
+		t->bytesPerLength[index] = totalBytes;
+		t->secondsPerLength[index] = std::chrono::duration<double>(t1 - t0).count();
+	}
+}
+
+template<typename Hasher>
+void TestScalingPerLength(std::vector<WorkingSetBuffer>& buffers, const std::vector<int>& cpus, int threadCount, size_t scalingIndex, Result& outResult)
+{
+	ThreadBarrier barrier(threadCount);
+	std::vector<ScalingThread> threads(threadCount);
+	std::vector<std::thread> workers;
+	for (int i = 0; i < threadCount; ++i)
+	{
+		threads[i].cpu = i < (int)cpus.size() ? cpus[i] : -1;
+		threads[i].buffer = &buffers[i];
+		threads[i].barrier = &barrier;
+		threads[i].hashsum = 0;
+		workers.push_back(std::thread(ScalingThreadLoop<Hasher>, &threads[i]));
+	}
+	for (int i = 0; i < threadCount; ++i)
+		workers[i].join();
+
+	if (outResult.scaling.size() <= scalingIndex)
+		outResult.scaling.resize(scalingIndex + 1);
+	Result::ScalingResult& res = outResult.scaling[scalingIndex];
+	res.threads = threadCount;
+	res.mbpsPerLength.resize(g_PerfLengths.size());
+	for (size_t index = 0; index < g_PerfLengths.size(); ++index)
+	{
+		size_t totalBytes = 0;
+		double maxSeconds = 0;
+		for (int i = 0; i < threadCount; ++i)
+		{
+			totalBytes += threads[i].bytesPerLength[index];
+			maxSeconds = std::max(maxSeconds, threads[i].secondsPerLength[index]);
+		}
+		if (maxSeconds <= 0)
+			continue;
+		float mbps = (float)((totalBytes / 1024.0 / 1024.0) / maxSeconds);
+		if (mbps > res.mbpsPerLength[index])
+			res.mbpsPerLength[index] = mbps;
+	}
+	for (int i = 0; i < threadCount; ++i)
+		outResult.hashsum ^= threads[i].hashsum;
+}
+#endif // #if SCALING_TEST
+
+
+// synthetic hash performance test on various string lengths
+template<typename Hasher>
+void TestPerformancePerLength(const SyntheticData& data, bool aligned, Result& outResult)
+{
+	Hasher hasher;
+
+	for (size_t index = 0; index < g_PerfLengths.size(); ++index)
+	{
+		const int len = g_PerfLengths[index];
+		size_t dataLen = data.size();
+
+		const uint8_t* dataPtr = data.data();
+		const bool counting = !aligned && g_PerfCounterGroup.IsOpen();
+		if (counting)
+			g_PerfCounterGroup.Start();
+		TimerBegin();
+		size_t pos = 0;
+		// unaligned: keys packed back to back; aligned: each key starts at a cache line
+		size_t lenAligned = len;
+		if (aligned)
+			lenAligned = (lenAligned + 63) & ~63;
+		if (lenAligned == 0)
+			lenAligned = 64;
+		size_t totalBytes = 0;
+		size_t totalHashes = 0;
+		while (pos + len < dataLen)
+		{
+			outResult.hashsum ^= hasher(dataPtr + pos, len);
+			pos += lenAligned;
+			totalBytes += len;
+			++totalHashes;
+		}
+		float sec = TimerEnd();
+		PerfCounterValues counters;
+		if (counting)
+		{
+			g_PerfCounterGroup.Stop();
+			if (g_PerfCounterGroup.Read(counters) && totalHashes)
+			{
+				for (int i = 0; i < kPerfCounterCount; ++i)
+					if (counters.Has(i))
+						counters.values[i] /= totalHashes;
+			}
+		}
+
+		// MB/s
+		float mbps = (float)((totalBytes / 1024.0 / 1024.0) / sec);
+		float cyclesPerHash = 0, cyclesPerByte = 0;
+#		if PLATFORM_HAS_CYCLE_COUNTER
+		cyclesPerHash = (float)(double(TimerLastCycles()) / totalHashes);
+		if (totalBytes)
+			cyclesPerByte = (float)(double(TimerLastCycles()) / totalBytes);
+#		endif
+		if (index >= outResult.mbpsPerLength.size())
+		{
+			// add result if no previous iterations did it yet
+			Result::PerfResult res;
+			res.length = len;
+			outResult.mbpsPerLength.push_back(res);
+		}
+
+		// if we got higher MB/s (or fewer cycles), use that (i.e. out of all iterations, we pick fastest one)
+		Result::PerfResult& res = outResult.mbpsPerLength[index];
+		assert(res.length == len);
+		(aligned ? res.mbpsAlignedSamples : res.mbpsSamples).push_back(mbps);
+		if (aligned)
+		{
+			if (mbps > res.mbpsAligned)
+				res.mbpsAligned = mbps;
+		}
+		else
+		{
+			if (mbps > res.mbps)
+				res.mbps = mbps;
+			float nsPerHash = totalHashes ? (float)(sec * 1.0e9 / totalHashes) : 0;
+			KeepMin(res.nsPerHash, nsPerHash);
+			if (res.cyclesPerHash == 0 || cyclesPerHash < res.cyclesPerHash)
+			{
+				res.cyclesPerHash = cyclesPerHash;
+				res.cyclesPerByte = cyclesPerByte;
+			}
+			if (counters.Has(kPerfCounterCycles) && (!res.counters.Has(kPerfCounterCycles) || counters.values[kPerfCounterCycles] < res.counters.values[kPerfCounterCycles]))
+				res.counters = counters;
+		}
+	}
+}
+
+
+// hash latency test: same data & lengths as above, but the input pointer of each hash call
+// depends on the previous hash value, so calls can't overlap in the CPU pipeline. That's
+// what a hashtable lookup sees, where the hash is on the critical path. The dependency
+// is "ANDed with zero" (a zero the compiler can't know about), which adds ~2 cycles per hash.
+template<typename Hasher>
+void TestLatencyPerLength(const SyntheticData& data, Result& outResult)
+{
+	Hasher hasher;
+	const size_t zero = g_LatencyZero;
+
+	for (size_t index = 0; index < g_PerfLengths.size(); ++index)
+	{
+		const int len = g_PerfLengths[index];
+		size_t dataLen = data.size();
+		const uint8_t* dataPtr = data.data();
+		size_t lenAligned = (len + 63) & ~63;
+		if (lenAligned == 0)
+			lenAligned = 64;
+
+		typename Hasher::HashType h = 0;
+		size_t pos = 0;
+		size_t totalHashes = 0;
+		TimerBegin();
+		while (pos + len < dataLen)
+		{
+			h = hasher(dataPtr + pos + ((size_t)h & zero), len);
+			pos += lenAligned;
+			++totalHashes;
+		}
+		float sec = TimerEnd();
+		outResult.hashsum ^= h;
+
+		if (index >= outResult.mbpsPerLength.size())
+		{
+			Result::PerfResult res;
+			res.length = len;
+			outResult.mbpsPerLength.push_back(res);
+		}
+		Result::PerfResult& res = outResult.mbpsPerLength[index];
+		assert(res.length == len);
+		float nsPerHash = totalHashes ? (float)(sec * 1.0e9 / totalHashes) : 0;
+		if (res.latencyNsPerHash == 0 || nsPerHash < res.latencyNsPerHash)
+			res.latencyNsPerHash = nsPerHash;
+	}
+}
+
+
+// ------------------------------------------------------------------------------------
+// Individual hash functions for use in the testing code above
+
+struct HasherXXH32 : public Hasher32Bit
+{
+	HashType operator()(const void* data, size_t size) const { return XXH32(data, size, 0x1234); }
+};
+struct HasherXXH64_32 : public Hasher32Bit
+{
+	HashType operator()(const void* data, size_t size) const { return (HashType)XXH64(data, size, 0x1234); }
+};
+struct HasherXXH64 : public Hasher64Bit
+{
+	HashType operator()(const void* data, size_t size) const { return XXH64(data, size, 0x1234); }
+};
+
+struct HasherSpookyV2_64 : public Hasher64Bit
+{
+	HashType operator()(const void* data, size_t size) const { return SpookyHash::Hash64(data, (int)size, 0x1234); }
+};
+
+struct HasherMurmur2A : public Hasher32Bit
+{
+	HashType operator()(const void* data, size_t size) const { return MurmurHash2A(data, (int)size, 0x1234); }
+};
+struct HasherMurmur3_32 : public Hasher32Bit
+{
+	HashType operator()(const void* data, size_t size) const { HashType res; MurmurHash3_x86_32(data, (int)size, 0x1234, &res); return res; }
+};
+struct HasherMurmur3_x64_128 : public Hasher64Bit
+{
+	HashType operator()(const void* data, size_t size) const { HashType res[2]; MurmurHash3_x64_128(data, (int)size, 0x1234, &res); return res[0]; }
+};
+
+struct HasherMum_32 : public Hasher32Bit
+{
+	HashType operator()(const void* data, size_t size) const { return (uint32_t)mum_hash(data, size, 0x1234); }
+};
+struct HasherMum : public Hasher64Bit
+{
+	HashType operator()(const void* data, size_t size) const { return mum_hash(data, size, 0x1234); }
+};
+
+struct HasherCity32 : public Hasher32Bit
+{
+	HashType operator()(const void* data, size_t size) const { return CityHash32((const char*)data, size); }
+};
+struct HasherCity64_32 : public Hasher32Bit
+{
+	HashType operator()(const void* data, size_t size) const { return (uint32_t)CityHash64((const char*)data, size); }
+};
+struct HasherCity64 : public Hasher64Bit
+{
+	HashType operator()(const void* data, size_t size) const { return CityHash64((const char*)data, size); }
+};
+
+struct HasherFarm32 : public Hasher32Bit
+{
+	HashType operator()(const void* data, size_t size) const { return util::Hash32((const char*)data, size); }
+};
+struct HasherFarm64_32 : public Hasher32Bit
+{
+	HashType operator()(const void* data, size_t size) const { return (uint32_t)util::Hash64((const char*)data, size); }
+};
+struct HasherFarm64 : public Hasher64Bit
+{
+	HashType operator()(const void* data, size_t size) const { return util::Hash64((const char*)data, size); }
+};
+
+// Reference SipHash implementation, https://github.com/veorq/SipHash
+static const uint8_t kSipHashKey[16] = {0x75,0x4E,0x3F,0x38, 0x21,0x0A,0xFE,0x71, 0x9D,0xDC,0x54,0x72, 0x09,0x1A,0xD4,0x79};
+struct HasherSipRef_32 : public Hasher32Bit
+{
+	HashType operator()(const void* data, size_t size) const { uint64_t res; siphash((uint8_t*)&res, (const uint8_t*)data, size, kSipHashKey); return (HashType)res; }
+};
+struct HasherSipRef : public Hasher64Bit
+{
+	HashType operator()(const void* data, size_t size) const { uint64_t res; siphash((uint8_t*)&res, (const uint8_t*)data, size, kSipHashKey); return res; }
+};
+
+struct HasherCRC32 : public Hasher32Bit
+{
+	HashType operator()(const void* data, size_t size) const { HashType res; crc32(data, (int)size, 0x1234, &res); return res; }
+};
+struct HasherMD5_32 : public Hasher32Bit
+{
+	HashType operator()(const void* data, size_t size) const
+	{
+		// Could do this on Apple platforms, from <CommonCrypto/CommonDigest.h> -- quick test
+		// shows that it's around 25% faster, but that does not change things much.
+		//uint32_t res[4]; CC_MD5(data, (unsigned int)size, (unsigned char*)res); return res[0];
+		HashType res; md5_32(data, (int)size, 0x1234, &res); return res;
+	}
+};
+struct HasherSHA1_32 : public Hasher32Bit
+{
+	HashType operator()(const void* data, size_t size) const
+	{
+		// Could do this on Apple platforms, from <CommonCrypto/CommonDigest.h> -- quick test
+		// shows that it's around 25% faster, but that does not change things much.
+		//uint32_t res[5]; CC_SHA1(data, (unsigned int)size, (unsigned char*)res); return res[0];
+		HashType res; sha1_32a(data, (int)size, 0x1234, &res); return res;
+	}
+};
+
+// 128 bit hash functions that have two independent 64 bit halves, for tests that use both
+// halves (cuckoo hashing); above, their 64 bit versions use only one half.
+struct Hasher128Murmur3_x64
+{
+	Hash128Value operator()(const void* data, size_t size) const { uint64_t res[2]; MurmurHash3_x64_128(data, (int)size, 0x1234, res); Hash128Value h = { res[0], res[1] }; return h; }
+};
+struct Hasher128SpookyV2
+{
+	Hash128Value operator()(const void* data, size_t size) const { uint64 h1 = 0x1234, h2 = 0x1234; SpookyHash::Hash128(data, size, &h1, &h2); Hash128Value h = { h1, h2 }; return h; }
+};
+struct Hasher128City
+{
+	Hash128Value operator()(const void* data, size_t size) const { uint128 res = CityHash128((const char*)data, size); Hash128Value h = { Uint128Low64(res), Uint128High64(res) }; return h; }
+};
+struct Hasher128Farm
+{
+	Hash128Value operator()(const void* data, size_t size) const { util::uint128_t res = util::Hash128((const char*)data, size); Hash128Value h = { util::Uint128Low64(res), util::Uint128High64(res) }; return h; }
+};
+
+
+// ------------------------------------------------------------------------------------
+// Main program
+
+static std::vector<DataSet*> g_DataSets;
+static SyntheticData g_SyntheticData;
+static std::vector<Result> g_Results;
+static int g_PerfAffinityCpu = 0; // CPU core to pin performance tests to, -1 to not pin (Linux only)
+
+typedef void (*TestHashQualityFunc)(const DataSet& dataset, Result::DataSetResult& outResult);
+typedef QualityAccumulator* (*CreateQualityAccumulatorFunc)(CollisionEngine engine);
+typedef void (*TestHashPerfFunc)(const SyntheticData& data, bool aligned, Result& outResult);
+typedef void (*TestHashLatencyFunc)(const SyntheticData& data, Result& outResult);
+#if SCALING_TEST
+typedef void (*TestHashScalingFunc)(std::vector<WorkingSetBuffer>& buffers, const std::vector<int>& cpus, int threadCount, size_t scalingIndex, Result& outResult);
+#	define SCALING_TEST_FUNC(clazz) TestScalingPerLength<clazz>
+#else
+typedef void* TestHashScalingFunc;
+#	define SCALING_TEST_FUNC(clazz) NULL
+#endif
+typedef void (*TestHashKeyMixFunc)(size_t mixIndex, Result& outResult);
+typedef void (*TestHashTableFunc)(size_t dataIndex, Result& outResult);
+typedef void (*TestHashBloomFunc)(size_t dataIndex, Result& outResult);
+typedef void (*TestHashOffsetsFunc)(const SyntheticData& data, Result& outResult);
+typedef void (*TestHashWorkingSetFunc)(WorkingSetBuffer& buffer, size_t workingSetIndex, Result& outResult);
+
+struct HashToTest
+{
+	const char* name;
+	TestHashQualityFunc qualityFunc;
+	CreateQualityAccumulatorFunc createQualityAccumulator; // for streamed data sets
+	TestHashPerfFunc perfFunc;
+	TestHashLatencyFunc latencyFunc;
+	TestHashWorkingSetFunc workingSetFunc;
+	TestHashOffsetsFunc offsetsFunc;
+	TestHashKeyMixFunc keyMixFunc;
+	TestHashScalingFunc scalingFunc;
+	TestHashTableFunc hashTableFunc;
+	TestHashBloomFunc bloomFunc;
+	bool excludeFromPerf;
+};
+static std::vector<HashToTest> g_Hashes;
+
+// 128 bit hash functions; only tested with --cuckoo & --bloom, they have no 32/64 bit HashType for the other tests
+typedef void (*TestHash128CuckooFunc)(size_t dataIndex, Result128& outResult);
+typedef void (*TestHash128BloomFunc)(size_t dataIndex, Result128& outResult);
+struct Hash128ToTest
+{
+	const char* name;
+	TestHash128CuckooFunc cuckooFunc;
+	TestHash128BloomFunc bloomFunc;
+};
+static std::vector<Hash128ToTest> g_Hashes128;
+static std::vector<Result128> g_Results128;
+
+static std::vector<std::string> g_HashFilters; // name patterns of hash functions to test; empty = all
+static std::vector<std::string> g_DataSetFiles; // dataset files to load; empty = the default ones
+static bool g_ListHashes = false;
+static bool g_RunQuality = true;
+static bool g_RunPerf = true;
+
+// case insensitive match with * and ? wildcards
+static bool MatchWildcard(const char* pattern, const char* str)
+{
+	for (; *pattern; ++pattern, ++str)
+	{
+		if (*pattern == '*')
+		{
+			for (const char* s = str; ; ++s)
+			{
+				if (MatchWildcard(pattern + 1, s))
+					return true;
+				if (!*s)
+					return false;
+			}
+		}
+		if (!*str)
+			return false;
+		if (*pattern != '?' && tolower((unsigned char)*pattern) != tolower((unsigned char)*str))
+			return false;
+	}
+	return *str == 0;
+}
+
+static bool HashMatchesFilters(const char* name)
+{
+	if (g_HashFilters.empty())
+		return true;
+	for (size_t i = 0; i < g_HashFilters.size(); ++i)
+		if (MatchWildcard(g_HashFilters[i].c_str(), name))
+			return true;
+	return false;
+}
+
+static void AddHash(const char* name, TestHashQualityFunc qualityFunc, CreateQualityAccumulatorFunc createQualityAccumulator, TestHashPerfFunc perfFunc, TestHashLatencyFunc latencyFunc, TestHashWorkingSetFunc workingSetFunc, TestHashOffsetsFunc offsetsFunc, TestHashKeyMixFunc keyMixFunc, TestHashScalingFunc scalingFunc, TestHashTableFunc hashTableFunc, TestHashBloomFunc bloomFunc, bool excludeFromPerf)
+{
+	if (!HashMatchesFilters(name))
+		return;
+	HashToTest h;
+	h.name = name;
+	h.qualityFunc = qualityFunc;
+	h.createQualityAccumulator = createQualityAccumulator;
+	h.perfFunc = perfFunc;
+	h.latencyFunc = latencyFunc;
+	h.workingSetFunc = workingSetFunc;
+	h.offsetsFunc = offsetsFunc;
+	h.keyMixFunc = keyMixFunc;
+	h.scalingFunc = scalingFunc;
+	h.hashTableFunc = hashTableFunc;
+	h.bloomFunc = bloomFunc;
+	h.excludeFromPerf = excludeFromPerf;
+	g_Hashes.push_back(h);
+}
+
+static void AddHash128(const char* name, TestHash128CuckooFunc cuckooFunc, TestHash128BloomFunc bloomFunc)
+{
+	if (!HashMatchesFilters(name))
+		return;
+	Hash128ToTest h;
+	h.name = name;
+	h.cuckooFunc = cuckooFunc;
+	h.bloomFunc = bloomFunc;
+	g_Hashes128.push_back(h);
+}
+
+
+// Quality tests of one (hash function, data set) pair can be split into shards that are hashed in
+// parallel, each into its own accumulator, and merged at the end; only the estimate engine can
+// merge, and the bucket reduction sweep can't. Multi-billion entry data sets are then not limited
+// to one thread per hash function: all hash functions times shards should about fill the threads.
+const size_t kQualityShardMinEntries = 1024 * 1024; // not worth splitting smaller ones
+
+static bool UsesReductionSweep(const DataSet& data)
+{
+	return g_RunReductionSweep && !data.IsStreamed() && data.entries.size() <= kReductionSweepMaxEntries;
+}
+
+static size_t GetQualityShardCount(const DataSet& data, CollisionEngine engine, int threadCount)
+{
+	const size_t entryCount = data.GetEntryCount();
+	if (engine != kCollisionEngineEstimate || UsesReductionSweep(data) || entryCount < 2 * kQualityShardMinEntries)
+		return 1;
+	size_t shards = ((size_t)threadCount + g_Hashes.size() - 1) / g_Hashes.size();
+	return std::max<size_t>(1, std::min(shards, entryCount / kQualityShardMinEntries));
+}
+
+struct QualityShardJob
+{
+	std::vector<QualityAccumulator*> accumulators; // [hashIndex * shardCount + shard]
+	size_t shardCount;
+	const DataSet* data; // whole data set, or the current window of a streamed one
+};
+
+static void QualityShardTask(void* userData, size_t index)
+{
+	QualityShardJob& job = *(QualityShardJob*)userData;
+	const size_t shard = index % job.shardCount;
+	const size_t count = job.data->entries.size();
+	job.accumulators[index]->Add(*job.data, count * shard / job.shardCount, count * (shard + 1) / job.shardCount);
+}
+
+static void BeginQualityShards(QualityShardJob& job, const DataSet& data, CollisionEngine engine, size_t shardCount)
+{
+	job.shardCount = shardCount;
+	job.accumulators.clear();
+	for (size_t i = 0; i < g_Hashes.size(); ++i)
+	{
+		for (size_t shard = 0; shard < shardCount; ++shard)
+		{
+			job.accumulators.push_back(g_Hashes[i].createQualityAccumulator(engine));
+			job.accumulators.back()->Begin(data.GetEntryCount(), UsesReductionSweep(data));
+		}
+	}
+}
+
+static void EndQualityShards(QualityShardJob& job, size_t dataIndex)
+{
+	for (size_t i = 0; i < g_Hashes.size(); ++i)
+	{
+		QualityAccumulator* acc = job.accumulators[i * job.shardCount];
+		for (size_t shard = 1; shard < job.shardCount; ++shard)
+		{
+			acc->Merge(*job.accumulators[i * job.shardCount + shard]);
+			delete job.accumulators[i * job.shardCount + shard];
+		}
+		acc->End(g_Results[i].datasets[dataIndex]);
+		delete acc;
+	}
+	job.accumulators.clear();
+}
+
+// userData: shard count of each data set; ones with more than one are done separately, see TestQualityInShards
+static void QualityTask(void* userData, size_t index)
+{
+	const std::vector<size_t>& shardCounts = *(const std::vector<size_t>*)userData;
+	const size_t hashIndex = index / g_DataSets.size();
+	const size_t dataIndex = index % g_DataSets.size();
+	if (g_DataSets[dataIndex]->IsStreamed() || shardCounts[dataIndex] > 1)
+		return; // done separately, see TestQualityOnStreamedDataSet & TestQualityInShards
+	g_Hashes[hashIndex].qualityFunc(*g_DataSets[dataIndex], g_Results[hashIndex].datasets[dataIndex]);
+}
+
+// A large loaded data set: all hash functions times shards of the entries are hashed in parallel
+static void TestQualityInShards(size_t dataIndex, size_t shardCount, TaskScheduler& scheduler)
+{
+	const DataSet& data = *g_DataSets[dataIndex];
+	QualityShardJob job;
+	BeginQualityShards(job, data, g_CollisionEngine, shardCount);
+	job.data = &data;
+	scheduler.RunTasks(job.accumulators.size(), QualityShardTask, &job);
+	EndQualityShards(job, dataIndex);
+}
+
+#if DATASET_STREAMING
+// Streamed data sets are read once, window by window; each window is hashed by all the
+// hash functions in parallel (and with the estimate engine, each one in several shards of the
+// window) before moving on to the next one. Memory use is bounded: two windows of
+// kDataSetStreamWindowSize (more only for longer lines), plus with the default estimate engine
+// under 2MB per hash function and shard. No bucket reduction sweep here, its bitmaps grow with
+// entry count.
+static void TestQualityOnStreamedDataSet(size_t dataIndex, TaskScheduler& scheduler)
+{
+	const DataSet& data = *g_DataSets[dataIndex];
+	DataSetStreamReader reader;
+	if (!reader.Open(data.streamPath))
+	{
+		fprintf(g_OutputFile, "error: can't open dataset file '%s'\n", data.name.c_str());
+		return;
+	}
+	QualityShardJob job;
+	BeginQualityShards(job, data, g_StreamCollisionEngine, GetQualityShardCount(data, g_StreamCollisionEngine, scheduler.GetThreadCount()));
+	while ((job.data = reader.NextWindow()) != NULL)
+		scheduler.RunTasks(job.accumulators.size(), QualityShardTask, &job);
+	EndQualityShards(job, dataIndex);
+}
+#endif // #if DATASET_STREAMING
+
+static void CreateSyntheticData()
+{
+	g_SyntheticData.resize(kSyntheticDataTotalSize);
+	for (size_t i = 0; i < kSyntheticDataTotalSize; ++i)
+		g_SyntheticData[i] = i;
+}
+
+// key lists for TestKeyMix; needs data sets and synthetic data to be loaded
+static void CreateKeyMixes()
+{
+	uint64_t rng = 1;
+	for (size_t id = 0; id < g_DataSets.size(); ++id)
+	{
+		const DataSet& data = *g_DataSets[id];
+		if (data.IsStreamed() || data.entries.size() == 0)
+			continue;
+		KeyMix mix;
+		mix.name = data.name + " (file order)";
+		mix.data = (const uint8_t*)data.fileData;
+		mix.entries = &data.entries;
+		mix.keyCount = std::min(data.entries.size(), kKeyMixMaxKeys);
+		auto addLength = [&](size_t, size_t length) { mix.totalBytes += length; };
+		data.entries.ForEachFirst(mix.keyCount, addLength);
+		g_KeyMixes.push_back(mix);
+
+		mix.name = data.name + " (shuffled)";
+		mix.order.resize(mix.keyCount);
+		for (size_t i = 0; i < mix.keyCount; ++i)
+			mix.order[i] = (uint32_t)i;
+		for (size_t i = mix.keyCount - 1; i > 0; --i)
+			std::swap(mix.order[i], mix.order[(size_t)(SplitMix64(rng) % (i + 1))]);
+		g_KeyMixes.push_back(mix);
+	}
+
+	// Zipf lengths: cumulative distribution, then keys packed back to back in synthetic data
+	std::vector<double> cdf(kZipfMaxLength);
+	double sum = 0;
+	for (int k = 1; k <= kZipfMaxLength; ++k)
+	{
+		sum += pow((double)k, -g_ZipfExponent);
+		cdf[k-1] = sum;
+	}
+	KeyMix mix;
+	char name[64];
+	snprintf(name, sizeof(name), "Zipf lengths 1..%i s=%.2f", kZipfMaxLength, g_ZipfExponent);
+	mix.name = name;
+	mix.data = g_SyntheticData.data();
+	mix.entries = &g_ZipfKeys;
+	mix.keyCount = kZipfKeyCount;
+	g_ZipfKeys.Allocate(kZipfKeyCount, DataSetEntries::OffsetSizeFor(g_SyntheticData.size()), DataSetEntries::LengthSizeFor(kZipfMaxLength));
+	size_t pos = 0;
+	for (size_t i = 0; i < kZipfKeyCount; ++i)
+	{
+		double u = (SplitMix64(rng) >> 11) * (1.0 / 9007199254740992.0) * sum;
+		size_t length = std::lower_bound(cdf.begin(), cdf.end(), u) - cdf.begin() + 1;
+		if (pos + length > g_SyntheticData.size())
+			pos = 0;
+		g_ZipfKeys.Set(i, pos, length);
+		mix.totalBytes += length;
+		pos += length;
+	}
+	g_KeyMixes.push_back(mix);
+}
+
+static void LoadDataSets(const char* folderName)
+{
+	// Basic collisions / hash quality tests on some real world data I had lying around:
+	// - Dictionary of English words from /usr/share/dict/words
+	// - A bunch of file relative paths + filenames from several Unity projects & test suites.
+	//   Imaginary use case, hashing filenames in some asset database / file storage system.
+	// - C++ source code, this was partial Unity sourcecode dump. I'm not releasing this one :),
+	//   but it was 6069 entries, 43.7MB total size, average size 7546.6 bytes.
+	// - Mostly binary data. I instrumented hash function calls, as used in Unity engine graphics
+	//   related parts, to dump actually hashed data into a log file. Unlike the test sets above,
+	//   most of the data here is binary, and represents snapshots of some internal structs in
+	//   memory.
+	if (g_DataSetFiles.empty())
+	{
+		g_DataSetFiles.push_back("TestData/test-words.txt");
+		g_DataSetFiles.push_back("TestData/test-filenames.txt");
+		g_DataSetFiles.push_back("TestData/test-code.txt");
+		g_DataSetFiles.push_back("TestData/test-binary.bin");
+	}
+	for (size_t i = 0; i < g_DataSetFiles.size(); ++i)
+	{
+		DataSet* data = ReadDataSet(folderName, g_DataSetFiles[i].c_str());
+		if (data)
+			g_DataSets.push_back(data);
+	}
+}
+
+static double GetPerfMBPS(const Result::PerfResult& r) { return r.mbps; }
+static double GetPerfMBPSAligned(const Result::PerfResult& r) { return r.mbpsAligned; }
+static double GetPerfMBPSMedian(const Result::PerfResult& r) { return r.mbpsStats.median; }
+static double GetPerfNsPerHash(const Result::PerfResult& r) { return r.nsPerHash; }
+static double GetPerfLatencyNsPerHash(const Result::PerfResult& r) { return r.latencyNsPerHash; }
+static double GetPerfIPC(const Result::PerfResult& r)
+{
+	const PerfCounterValues& c = r.counters;
+	return c.Has(kPerfCounterInstructions) && c.values[kPerfCounterCycles] > 0 ? c.values[kPerfCounterInstructions] / c.values[kPerfCounterCycles] : 0;
+}
+static double GetPerfBranchMissRate(const Result::PerfResult& r)
+{
+	const PerfCounterValues& c = r.counters;
+	return c.Has(kPerfCounterBranchMisses) && c.values[kPerfCounterBranches] > 0 ? c.values[kPerfCounterBranchMisses] / c.values[kPerfCounterBranches] * 100.0 : 0;
+}
+static double GetPerfInstructionsPerByte(const Result::PerfResult& r)
+{
+	const PerfCounterValues& c = r.counters;
+	return c.Has(kPerfCounterInstructions) && r.length > 0 ? c.values[kPerfCounterInstructions] / r.length : 0;
+}
+static double GetPerfL1DMissesPerHash(const Result::PerfResult& r) { return r.counters.Has(kPerfCounterL1DMisses) ? r.counters.values[kPerfCounterL1DMisses] : 0; }
+static double GetPerfUopsPerHash(const Result::PerfResult& r) { return r.counters.Has(kPerfCounterUops) ? r.counters.values[kPerfCounterUops] : 0; }
+static double GetPerfMBPSCIWidth(const Result::PerfResult& r) { return r.mbpsStats.GetRelativeCIWidth(); }
+static double GetPerfCyclesPerHash(const Result::PerfResult& r) { return r.cyclesPerHash; }
+static double GetPerfCyclesPerByte(const Result::PerfResult& r) { return r.cyclesPerByte; }
+
+static void PrintPerfTable(const char* title, double (*getValue)(const Result::PerfResult&), const char* valueFormat)
+{
+	size_t firstPerf = 0;
+	while (firstPerf < g_Hashes.size() && g_Hashes[firstPerf].excludeFromPerf)
+		++firstPerf;
+	if (firstPerf == g_Hashes.size())
+		return;
+	const std::vector<Result::PerfResult>& lengths = g_Results[firstPerf].mbpsPerLength;
+
+	fprintf(g_OutputFile, "%s", title);
+	fprintf(g_OutputFile, "DataSize,");
+	for (size_t ia = 0; ia < g_Hashes.size(); ++ia)
+	{
+		if (g_Hashes[ia].excludeFromPerf)
+			continue;
+		fprintf(g_OutputFile, "%s,", g_Hashes[ia].name);
+	}
+	fprintf(g_OutputFile, "\n");
+	for (size_t is = 0; is < lengths.size(); ++is)
+	{
+		fprintf(g_OutputFile, "%i,", lengths[is].length);
+		for (size_t ia = 0; ia < g_Results.size(); ++ia)
+		{
+			if (g_Hashes[ia].excludeFromPerf)
+				continue;
+			fprintf(g_OutputFile, valueFormat, getValue(g_Results[ia].mbpsPerLength[is]));
+		}
+		fprintf(g_OutputFile, "\n");
+	}
+	fprintf(g_OutputFile, "\n");
+}
+
+// Performance cliffs: places where median MB/s drops sharply from one tested length to the next
+// (i.e. time per hash jumps), typically where a hash function switches to another code path.
+// With enough samples, the drop only counts when the two confidence intervals don't overlap.
+// Only looked for with --dense, or when the tested lengths are contiguous anyway; between the
+// sparse default lengths MB/s changes a lot just because of length.
+static float g_CliffThreshold = 10.0f; // % MB/s drop
+static bool g_PerfLengthsDense = false; // --dense given
+
+static bool ShouldFindPerfCliffs()
+{
+	if (g_PerfLengthsDense)
+		return true;
+	for (size_t is = 1; is < g_PerfLengths.size(); ++is)
+	{
+		if (g_PerfLengths[is] != g_PerfLengths[is-1] + 1)
+			return false;
+	}
+	return g_PerfLengths.size() > 1;
+}
+
+struct PerfCliff
+{
+	int fromLength, toLength;
+	float drop; // %
+};
+
+static void FindPerfCliffs(const Result& res, std::vector<PerfCliff>& outCliffs)
+{
+	outCliffs.clear();
+	if (!ShouldFindPerfCliffs())
+		return;
+	for (size_t is = 1; is < res.mbpsPerLength.size(); ++is)
+	{
+		const Result::PerfResult& prev = res.mbpsPerLength[is-1];
+		const Result::PerfResult& cur = res.mbpsPerLength[is];
+		if (prev.mbpsStats.median <= 0 || cur.length <= prev.length)
+			continue;
+		float drop = (float)((1.0 - cur.mbpsStats.median / prev.mbpsStats.median) * 100.0);
+		if (drop <= g_CliffThreshold)
+			continue;
+		if (prev.mbpsStats.count >= 3 && cur.mbpsStats.count >= 3 && cur.mbpsStats.ciHigh >= prev.mbpsStats.ciLow)
+			continue;
+		PerfCliff cliff = { prev.length, cur.length, drop };
+		outCliffs.push_back(cliff);
+	}
+}
+
+static void PrintPerfCliffs()
+{
+	if (!ShouldFindPerfCliffs())
+		return;
+	fprintf(g_OutputFile, "\n**** Performance cliffs, median MB/s drops over %.0f%% from one length to the next\n", g_CliffThreshold);
+	std::vector<PerfCliff> cliffs;
+	for (size_t ia = 0; ia < g_Results.size(); ++ia)
+	{
+		FindPerfCliffs(g_Results[ia], cliffs);
+		if (cliffs.empty())
+			continue;
+		fprintf(g_OutputFile, "%15s", g_Results[ia].name.c_str());
+		for (size_t i = 0; i < cliffs.size(); ++i)
+			fprintf(g_OutputFile, " %i->%i: -%.0f%%", cliffs[i].fromLength, cliffs[i].toLength, cliffs[i].drop);
+		fprintf(g_OutputFile, "\n");
+	}
+}
+
+static void PrintKeyMixTables()
+{
+	if (g_KeyMixes.empty())
+		return;
+	for (int table = 0; table < 2; ++table)
+	{
+		fprintf(g_OutputFile, "%s", table == 0 ? "\n**** Key mixes, million keys/s\nKeys," : "\n**** Key mixes, MB/s\nKeys,");
+		for (size_t ia = 0; ia < g_Hashes.size(); ++ia)
+		{
+			if (!g_Hashes[ia].excludeFromPerf)
+				fprintf(g_OutputFile, "%s,", g_Hashes[ia].name);
+		}
+		fprintf(g_OutputFile, "\n");
+		for (size_t im = 0; im < g_KeyMixes.size(); ++im)
+		{
+			fprintf(g_OutputFile, "%s; %i keys; avg length %.1f,", g_KeyMixes[im].name.c_str(), (int)g_KeyMixes[im].keyCount, double(g_KeyMixes[im].totalBytes) / g_KeyMixes[im].keyCount);
+			for (size_t ia = 0; ia < g_Hashes.size(); ++ia)
+			{
+				if (g_Hashes[ia].excludeFromPerf)
+					continue;
+				const std::vector<Result::KeyMixResult>& mixes = g_Results[ia].keyMixes;
+				if (im >= mixes.size())
+					fprintf(g_OutputFile, ",");
+				else if (table == 0)
+					fprintf(g_OutputFile, "%.1f,", mixes[im].keysPerSec / 1.0e6);
+				else
+					fprintf(g_OutputFile, "%.0f,", mixes[im].mbps);
+			}
+			fprintf(g_OutputFile, "\n");
+		}
+		fprintf(g_OutputFile, "\n");
+	}
+}
+
+static double GetHashTableInsertNs(const Result::HashTableResult& r) { return r.insertNs; }
+static double GetHashTableHitNs(const Result::HashTableResult& r) { return r.hitNs; }
+static double GetHashTableMissNs(const Result::HashTableResult& r) { return r.missNs; }
+static double GetHashTableHitProbesAvg(const Result::HashTableResult& r) { return r.hitProbesAvg; }
+static double GetHashTableMissProbesAvg(const Result::HashTableResult& r) { return r.missProbesAvg; }
+static double GetHashTableHitProbesMax(const Result::HashTableResult& r) { return r.hitProbesMax; }
+static double GetHashTableMissProbesMax(const Result::HashTableResult& r) { return r.missProbesMax; }
+
+static double GetSwissTableInsertNs(const Result::SwissTableResult& r) { return r.insertNs; }
+static double GetSwissTableHitNs(const Result::SwissTableResult& r) { return r.hitNs; }
+static double GetSwissTableMissNs(const Result::SwissTableResult& r) { return r.missNs; }
+static double GetSwissTableMissGroupsAvg(const Result::SwissTableResult& r) { return r.missGroupsAvg; }
+static double GetSwissTableFalseMatchRate(const Result::SwissTableResult& r) { return r.falseMatchRate; }
+
+// row labels of the tables below; empty for data sets that the test was not done on
+static std::string GetHashTableRowLabel(size_t dataIndex)
+{
+	const size_t keyCount = g_DataSetKeys[dataIndex].size();
+	if (keyCount < 2)
+		return std::string();
+	char label[32];
+	snprintf(label, sizeof(label), "; %i keys", (int)keyCount);
+	return g_DataSets[dataIndex]->name + label;
+}
+
+static std::string GetCuckooRowLabel(size_t dataIndex)
+{
+	return GetCuckooCapacity(g_DataSetKeys[dataIndex].size()) ? GetHashTableRowLabel(dataIndex) : std::string();
+}
+
+static std::string GetBloomRowLabel(size_t dataIndex)
+{
+	const size_t keyCount = g_DataSetKeys[dataIndex].size();
+	if (keyCount < 2)
+		return std::string();
+	// theory only depends on filter size, same for all hash functions
+	BlockedBloomFilter filter;
+	const size_t insertCount = (keyCount + 1) / 2;
+	filter.Reset(insertCount * kBloomBitsPerKey, kBloomProbeCount);
+	char label[64];
+	snprintf(label, sizeof(label), "; theory %.3f%% FP", filter.GetExpectedFalsePositiveRate(insertCount) * 100.0);
+	return GetHashTableRowLabel(dataIndex) + label;
+}
+
+// One row per data set; columns are the hash functions, then the 128 bit ones. results and
+// results128 are which per data set result vector of Result / Result128 to print; either can be
+// NULL to leave those hash functions out.
+template<typename T>
+static void PrintHashTableTable(const char* title, std::vector<T> Result::*results, std::vector<T> Result128::*results128, std::string (*getRowLabel)(size_t dataIndex), double (*getValue)(const T&), const char* valueFormat)
+{
+	fprintf(g_OutputFile, "%s", title);
+	fprintf(g_OutputFile, "DataSet,");
+	for (size_t ia = 0; ia < g_Hashes.size() && results; ++ia)
+	{
+		if (!g_Hashes[ia].excludeFromPerf)
+			fprintf(g_OutputFile, "%s,", g_Hashes[ia].name);
+	}
+	for (size_t ia = 0; ia < g_Results128.size() && results128; ++ia)
+		fprintf(g_OutputFile, "%s,", g_Results128[ia].name.c_str());
+	fprintf(g_OutputFile, "\n");
+	for (size_t id = 0; id < g_DataSetKeys.size(); ++id)
+	{
+		const std::string label = getRowLabel(id);
+		if (label.empty())
+			continue;
+		fprintf(g_OutputFile, "%s,", label.c_str());
+		for (size_t ia = 0; ia < g_Hashes.size() && results; ++ia)
+		{
+			if (!g_Hashes[ia].excludeFromPerf)
+				fprintf(g_OutputFile, valueFormat, getValue((g_Results[ia].*results)[id]));
+		}
+		for (size_t ia = 0; ia < g_Results128.size() && results128; ++ia)
+			fprintf(g_OutputFile, valueFormat, getValue((g_Results128[ia].*results128)[id]));
+		fprintf(g_OutputFile, "\n");
+	}
+	fprintf(g_OutputFile, "\n");
+}
+
+static double GetRobinHoodInsertNs(const Result::RobinHoodResult& r) { return r.insertNs; }
+static double GetRobinHoodHitNs(const Result::RobinHoodResult& r) { return r.hitNs; }
+static double GetRobinHoodMissNs(const Result::RobinHoodResult& r) { return r.missNs; }
+static double GetRobinHoodHitProbesMean(const Result::RobinHoodResult& r) { return r.hitProbesMean; }
+static double GetRobinHoodHitProbesP99(const Result::RobinHoodResult& r) { return r.hitProbesP99; }
+static double GetRobinHoodHitProbesMax(const Result::RobinHoodResult& r) { return r.hitProbesMax; }
+static double GetRobinHoodMissProbesMean(const Result::RobinHoodResult& r) { return r.missProbesMean; }
+static double GetRobinHoodMissProbesP99(const Result::RobinHoodResult& r) { return r.missProbesP99; }
+static double GetRobinHoodMissProbesMax(const Result::RobinHoodResult& r) { return r.missProbesMax; }
+
+// one row per data set & load factor
+static void PrintRobinHoodTable(const char* title, double (*getValue)(const Result::RobinHoodResult&), const char* valueFormat)
+{
+	fprintf(g_OutputFile, "%s", title);
+	fprintf(g_OutputFile, "DataSet,");
+	for (size_t ia = 0; ia < g_Hashes.size(); ++ia)
+	{
+		if (!g_Hashes[ia].excludeFromPerf)
+			fprintf(g_OutputFile, "%s,", g_Hashes[ia].name);
+	}
+	fprintf(g_OutputFile, "\n");
+	for (size_t id = 0; id < g_DataSetKeys.size(); ++id)
+	{
+		const size_t capacity = GetRobinHoodCapacity(g_DataSetKeys[id].size());
+		if (capacity == 0)
+			continue;
+		for (size_t il = 0; il < kRobinHoodLoadFactorCount; ++il)
+		{
+			fprintf(g_OutputFile, "%s; %i slots; load %.2f,", g_DataSets[id]->name.c_str(), (int)capacity, kRobinHoodLoadFactors[il]);
+			for (size_t ia = 0; ia < g_Hashes.size(); ++ia)
+			{
+				if (g_Hashes[ia].excludeFromPerf)
+					continue;
+				const Result::RobinHoodResult& res = g_Results[ia].robinHood[id][il];
+				if (res.loadFactor > 0)
+					fprintf(g_OutputFile, valueFormat, getValue(res));
+				else
+					fprintf(g_OutputFile, ",");
+			}
+			fprintf(g_OutputFile, "\n");
+		}
+	}
+	fprintf(g_OutputFile, "\n");
+}
+
+static void PrintHashTableTables()
+{
+	if (g_RunHashTable)
+	{
+		std::vector<Result::HashTableResult> Result::*res = &Result::hashTables;
+		std::vector<Result::HashTableResult> Result128::*none = NULL;
+		PrintHashTableTable("\n**** Hash table (linear probing), ns/lookup of present keys\n", res, none, GetHashTableRowLabel, GetHashTableHitNs, "%.1f,");
+		PrintHashTableTable("\n**** Hash table (linear probing), ns/lookup of missing keys\n", res, none, GetHashTableRowLabel, GetHashTableMissNs, "%.1f,");
+		PrintHashTableTable("\n**** Hash table (linear probing), ns/insert\n", res, none, GetHashTableRowLabel, GetHashTableInsertNs, "%.1f,");
+		PrintHashTableTable("\n**** Hash table (linear probing), average probes/lookup of present keys\n", res, none, GetHashTableRowLabel, GetHashTableHitProbesAvg, "%.3f,");
+		PrintHashTableTable("\n**** Hash table (linear probing), average probes/lookup of missing keys\n", res, none, GetHashTableRowLabel, GetHashTableMissProbesAvg, "%.3f,");
+		PrintHashTableTable("\n**** Hash table (linear probing), max probes/lookup of present keys\n", res, none, GetHashTableRowLabel, GetHashTableHitProbesMax, "%.0f,");
+		PrintHashTableTable("\n**** Hash table (linear probing), max probes/lookup of missing keys\n", res, none, GetHashTableRowLabel, GetHashTableMissProbesMax, "%.0f,");
+	}
+	if (g_RunSwissTable)
+	{
+		std::vector<Result::SwissTableResult> Result::*res = &Result::swissTables;
+		std::vector<Result::SwissTableResult> Result128::*none = NULL;
+		PrintHashTableTable("\n**** Swiss table, ns/lookup of present keys\n", res, none, GetHashTableRowLabel, GetSwissTableHitNs, "%.1f,");
+		PrintHashTableTable("\n**** Swiss table, ns/lookup of missing keys\n", res, none, GetHashTableRowLabel, GetSwissTableMissNs, "%.1f,");
+		PrintHashTableTable("\n**** Swiss table, ns/insert\n", res, none, GetHashTableRowLabel, GetSwissTableInsertNs, "%.1f,");
+		PrintHashTableTable("\n**** Swiss table, average groups/lookup of missing keys\n", res, none, GetHashTableRowLabel, GetSwissTableMissGroupsAvg, "%.3f,");
+		PrintHashTableTable("\n**** Swiss table, tag false positives, % of occupied slots compared (ideal: 0.78)\n", res, none, GetHashTableRowLabel, GetSwissTableFalseMatchRate, "%.2f,");
+	}
+	if (g_RunRobinHood)
+	{
+		PrintRobinHoodTable("\n**** Robin Hood table, ns/lookup of present keys\n", GetRobinHoodHitNs, "%.1f,");
+		PrintRobinHoodTable("\n**** Robin Hood table, ns/lookup of missing keys\n", GetRobinHoodMissNs, "%.1f,");
+		PrintRobinHoodTable("\n**** Robin Hood table, ns/insert (since previous load factor)\n", GetRobinHoodInsertNs, "%.1f,");
+		PrintRobinHoodTable("\n**** Robin Hood table, mean probes/lookup of present keys\n", GetRobinHoodHitProbesMean, "%.3f,");
+		PrintRobinHoodTable("\n**** Robin Hood table, p99 probes/lookup of present keys\n", GetRobinHoodHitProbesP99, "%.0f,");
+		PrintRobinHoodTable("\n**** Robin Hood table, max probes/lookup of present keys\n", GetRobinHoodHitProbesMax, "%.0f,");
+		PrintRobinHoodTable("\n**** Robin Hood table, mean probes/lookup of missing keys\n", GetRobinHoodMissProbesMean, "%.3f,");
+		PrintRobinHoodTable("\n**** Robin Hood table, p99 probes/lookup of missing keys\n", GetRobinHoodMissProbesP99, "%.0f,");
+		PrintRobinHoodTable("\n**** Robin Hood table, max probes/lookup of missing keys\n", GetRobinHoodMissProbesMax, "%.0f,");
+	}
+}
+
+static double GetCuckooTableLoadFactor(const Result128::CuckooTableResult& r) { return r.loadFactor; }
+static double GetCuckooTableInsertNs(const Result128::CuckooTableResult& r) { return r.insertNs; }
+static double GetCuckooTableHitNs(const Result128::CuckooTableResult& r) { return r.hitNs; }
+static double GetCuckooTableMissNs(const Result128::CuckooTableResult& r) { return r.missNs; }
+static double GetCuckooTableKicksMean(const Result128::CuckooTableResult& r) { return r.kicksMean; }
+static double GetCuckooTableKicksMax(const Result128::CuckooTableResult& r) { return r.kicksMax; }
+static double GetCuckooFilterLoadFactor(const Result128::CuckooFilterResult& r) { return r.loadFactor; }
+static double GetCuckooFilterInsertNs(const Result128::CuckooFilterResult& r) { return r.insertNs; }
+static double GetCuckooFilterHitNs(const Result128::CuckooFilterResult& r) { return r.hitNs; }
+static double GetCuckooFilterMissNs(const Result128::CuckooFilterResult& r) { return r.missNs; }
+static double GetCuckooFilterFalsePositiveRate(const Result128::CuckooFilterResult& r) { return r.falsePositiveRate; }
+static double GetCuckooFilterExpectedFalsePositiveRate(const Result128::CuckooFilterResult& r) { return r.expectedFalsePositiveRate; }
+
+static void PrintCuckooTables()
+{
+	if (!g_RunCuckoo || g_Results128.empty())
+		return;
+	std::vector<Result128::CuckooTableResult> Result128::*table = &Result128::cuckooTables;
+	std::vector<Result128::CuckooTableResult> Result::*noTable = NULL;
+	PrintHashTableTable("\n**** Cuckoo table (2 buckets of 4 from one 128 bit hash), load factor reached before an insert failed\n", noTable, table, GetCuckooRowLabel, GetCuckooTableLoadFactor, "%.3f,");
+	PrintHashTableTable("\n**** Cuckoo table, ns/lookup of present keys (latency)\n", noTable, table, GetCuckooRowLabel, GetCuckooTableHitNs, "%.1f,");
+	PrintHashTableTable("\n**** Cuckoo table, ns/lookup of missing keys (latency)\n", noTable, table, GetCuckooRowLabel, GetCuckooTableMissNs, "%.1f,");
+	PrintHashTableTable("\n**** Cuckoo table, ns/insert\n", noTable, table, GetCuckooRowLabel, GetCuckooTableInsertNs, "%.1f,");
+	PrintHashTableTable("\n**** Cuckoo table, mean kicks of a successful insert\n", noTable, table, GetCuckooRowLabel, GetCuckooTableKicksMean, "%.3f,");
+	PrintHashTableTable("\n**** Cuckoo table, max kicks of a successful insert\n", noTable, table, GetCuckooRowLabel, GetCuckooTableKicksMax, "%.0f,");
+	std::vector<Result128::CuckooFilterResult> Result128::*filter = &Result128::cuckooFilters;
+	std::vector<Result128::CuckooFilterResult> Result::*noFilter = NULL;
+	PrintHashTableTable("\n**** Cuckoo filter (16 bit fingerprints), load factor reached before an insert failed\n", noFilter, filter, GetCuckooRowLabel, GetCuckooFilterLoadFactor, "%.3f,");
+	PrintHashTableTable("\n**** Cuckoo filter, ns/lookup of present keys (latency)\n", noFilter, filter, GetCuckooRowLabel, GetCuckooFilterHitNs, "%.1f,");
+	PrintHashTableTable("\n**** Cuckoo filter, ns/lookup of missing keys (latency)\n", noFilter, filter, GetCuckooRowLabel, GetCuckooFilterMissNs, "%.1f,");
+	PrintHashTableTable("\n**** Cuckoo filter, ns/insert\n", noFilter, filter, GetCuckooRowLabel, GetCuckooFilterInsertNs, "%.1f,");
+	PrintHashTableTable("\n**** Cuckoo filter, false positive % of missing keys\n", noFilter, filter, GetCuckooRowLabel, GetCuckooFilterFalsePositiveRate, "%.4f,");
+	PrintHashTableTable("\n**** Cuckoo filter, expected false positive % at the load factor reached\n", noFilter, filter, GetCuckooRowLabel, GetCuckooFilterExpectedFalsePositiveRate, "%.4f,");
+}
+
+static double GetBloomSeparateMqps(const Result::BloomFilterResult& r) { return r.separateQps / 1.0e6; }
+static double GetBloomSeparateBatchMqps(const Result::BloomFilterResult& r) { return r.separateBatchQps / 1.0e6; }
+static double GetBloomDoubleMqps(const Result::BloomFilterResult& r) { return r.doubleQps / 1.0e6; }
+static double GetBloomDoubleBatchMqps(const Result::BloomFilterResult& r) { return r.doubleBatchQps / 1.0e6; }
+static double GetBloomSeparateFalsePositiveRate(const Result::BloomFilterResult& r) { return r.separateFalsePositiveRate; }
+static double GetBloomDoubleFalsePositiveRate(const Result::BloomFilterResult& r) { return r.doubleFalsePositiveRate; }
+
+static void PrintBloomTables()
+{
+	if (!g_RunBloom)
+		return;
+	PrintHashTableTable("\n**** Blocked Bloom filter, M queries/s, k salted & remixed hash calls of key length + 8 bytes\n", &Result::bloomFilters, &Result128::bloomFilters, GetBloomRowLabel, GetBloomSeparateMqps, "%.1f,");
+	PrintHashTableTable("\n**** Blocked Bloom filter, M queries/s, k salted & remixed hash calls of key length + 8 bytes, batched with prefetch\n", &Result::bloomFilters, &Result128::bloomFilters, GetBloomRowLabel, GetBloomSeparateBatchMqps, "%.1f,");
+	PrintHashTableTable("\n**** Blocked Bloom filter, M queries/s, double hashing of one hash call\n", &Result::bloomFilters, &Result128::bloomFilters, GetBloomRowLabel, GetBloomDoubleMqps, "%.1f,");
+	PrintHashTableTable("\n**** Blocked Bloom filter, M queries/s, double hashing of one hash call, batched with prefetch\n", &Result::bloomFilters, &Result128::bloomFilters, GetBloomRowLabel, GetBloomDoubleBatchMqps, "%.1f,");
+	PrintHashTableTable("\n**** Blocked Bloom filter, false positive % of missing keys, k salted & remixed hash calls of key length + 8 bytes\n", &Result::bloomFilters, &Result128::bloomFilters, GetBloomRowLabel, GetBloomSeparateFalsePositiveRate, "%.3f,");
+	PrintHashTableTable("\n**** Blocked Bloom filter, false positive % of missing keys, double hashing of one hash call\n", &Result::bloomFilters, &Result128::bloomFilters, GetBloomRowLabel, GetBloomDoubleFalsePositiveRate, "%.3f,");
+}
+
+// worst cache line offset, and page straddling keys, vs. keys at offset 0
+static void PrintOffsetTables()
+{
+	if (!g_RunOffsetSweep)
+		return;
+	for (int table = 0; table < 3; ++table)
+	{
+		const char* kTitles[] = {
+			"\n**** Misaligned data, slowest cache line offset, % slower than offset 0\n",
+			"\n**** Misaligned data, slowest cache line offset\n",
+			"\n**** Misaligned data, keys straddling pages, % slower than offset 0\n",
+		};
+		fprintf(g_OutputFile, "%sDataSize,", kTitles[table]);
+		for (size_t ia = 0; ia < g_Hashes.size(); ++ia)
+		{
+			if (!g_Hashes[ia].excludeFromPerf)
+				fprintf(g_OutputFile, "%s,", g_Hashes[ia].name);
+		}
+		fprintf(g_OutputFile, "\n");
+		for (size_t is = 0; is < g_PerfLengths.size(); ++is)
+		{
+			fprintf(g_OutputFile, "%i,", g_PerfLengths[is]);
+			for (size_t ia = 0; ia < g_Hashes.size(); ++ia)
+			{
+				if (g_Hashes[ia].excludeFromPerf)
+					continue;
+				const std::vector<Result::OffsetResult>& offsets = g_Results[ia].offsets;
+				if (offsets.size() != kOffsetCount || offsets[0].mbpsPerLength[is] <= 0)
+				{
+					fprintf(g_OutputFile, ",");
+					continue;
+				}
+				const float base = offsets[0].mbpsPerLength[is];
+				size_t worst = 0;
+				for (size_t io = 1; io < 64; ++io)
+				{
+					if (offsets[io].mbpsPerLength[is] < offsets[worst].mbpsPerLength[is])
+						worst = io;
+				}
+				if (table == 0)
+					fprintf(g_OutputFile, "%.1f,", (1.0f - offsets[worst].mbpsPerLength[is] / base) * 100.0f);
+				else if (table == 1)
+					fprintf(g_OutputFile, "%i,", (int)worst);
+				else if (offsets[64].mbpsPerLength[is] > 0)
+					fprintf(g_OutputFile, "%.1f,", (1.0f - offsets[64].mbpsPerLength[is] / base) * 100.0f);
+				else
+					fprintf(g_OutputFile, ",");
+			}
+			fprintf(g_OutputFile, "\n");
+		}
+		fprintf(g_OutputFile, "\n");
+	}
+}
+
+// per thread count: aggregate MB/s, and per thread efficiency vs. the single thread result
+static void PrintScalingTables()
+{
+	size_t firstPerf = 0;
+	while (firstPerf < g_Hashes.size() && g_Hashes[firstPerf].excludeFromPerf)
+		++firstPerf;
+	if (firstPerf == g_Hashes.size())
+		return;
+	const std::vector<Result::ScalingResult>& counts = g_Results[firstPerf].scaling;
+	for (size_t ic = 0; ic < counts.size(); ++ic)
+	{
+		for (int table = 0; table < (ic ? 2 : 1); ++table)
+		{
+			if (table == 0)
+				fprintf(g_OutputFile, "\n**** %i threads, aggregate MB/s\nDataSize,", counts[ic].threads);
+			else
+				fprintf(g_OutputFile, "\n**** %i threads, per thread efficiency vs. 1 thread, %%\nDataSize,", counts[ic].threads);
+			for (size_t ia = 0; ia < g_Hashes.size(); ++ia)
+			{
+				if (!g_Hashes[ia].excludeFromPerf)
+					fprintf(g_OutputFile, "%s,", g_Hashes[ia].name);
+			}
+			fprintf(g_OutputFile, "\n");
+			for (size_t is = 0; is < g_PerfLengths.size(); ++is)
+			{
+				fprintf(g_OutputFile, "%i,", g_PerfLengths[is]);
+				for (size_t ia = 0; ia < g_Hashes.size(); ++ia)
+				{
+					if (g_Hashes[ia].excludeFromPerf)
+						continue;
+					const std::vector<Result::ScalingResult>& sc = g_Results[ia].scaling;
+					float mbps = ic < sc.size() ? sc[ic].mbpsPerLength[is] : 0;
+					if (table == 0)
+						fprintf(g_OutputFile, "%.0f,", mbps);
+					else if (ic < sc.size() && sc[0].mbpsPerLength[is] > 0)
+						fprintf(g_OutputFile, "%.0f,", mbps / (sc[0].mbpsPerLength[is] * sc[ic].threads) * 100.0f);
+					else
+						fprintf(g_OutputFile, ",");
+				}
+				fprintf(g_OutputFile, "\n");
+			}
+			fprintf(g_OutputFile, "\n");
+		}
+	}
+}
+
+static void PrintWorkingSetTables()
+{
+	for (size_t iw = 0; iw < g_WorkingSetSizes.size(); ++iw)
+	{
+		fprintf(g_OutputFile, "\n**** Working set %s, MB/s\nDataSize,", FormatByteSize(g_WorkingSetSizes[iw]).c_str());
+		for (size_t ia = 0; ia < g_Hashes.size(); ++ia)
+		{
+			if (!g_Hashes[ia].excludeFromPerf)
+				fprintf(g_OutputFile, "%s,", g_Hashes[ia].name);
+		}
+		fprintf(g_OutputFile, "\n");
+		for (size_t is = 0; is < g_PerfLengths.size(); ++is)
+		{
+			fprintf(g_OutputFile, "%i,", g_PerfLengths[is]);
+			for (size_t ia = 0; ia < g_Hashes.size(); ++ia)
+			{
+				if (g_Hashes[ia].excludeFromPerf)
+					continue;
+				const std::vector<Result::WorkingSetResult>& ws = g_Results[ia].workingSets;
+				fprintf(g_OutputFile, "%.0f,", iw < ws.size() && is < ws[iw].mbpsPerLength.size() ? ws[iw].mbpsPerLength[is] : 0.0f);
+			}
+			fprintf(g_OutputFile, "\n");
+		}
+		fprintf(g_OutputFile, "\n");
+	}
+}
+
+// hashtable collisions increase % for every load factor & bucket reduction, on one data set
+static void PrintReductionTable(size_t dataIndex)
+{
+	if (!g_RunReductionSweep)
+		return;
+	if (g_DataSets[dataIndex]->IsStreamed())
+	{
+		fprintf(g_OutputFile, "(no bucket reduction sweep on streamed datasets)\n");
+		return;
+	}
+	if (g_DataSets[dataIndex]->GetEntryCount() > kReductionSweepMaxEntries)
+	{
+		fprintf(g_OutputFile, "(too many entries for the bucket reduction sweep)\n");
+		return;
+	}
+	fprintf(g_OutputFile, "HTColsIncrease %% by load factor & bucket reduction\nLoad; Reduction,");
+	for (size_t ia = 0; ia < g_Results.size(); ++ia)
+		fprintf(g_OutputFile, "%s,", g_Results[ia].name.c_str());
+	fprintf(g_OutputFile, "\n");
+	for (int il = 0; il < kReductionLoadFactorCount; ++il)
+	{
+		for (int ir = 0; ir < kReductionCount; ++ir)
+		{
+			fprintf(g_OutputFile, "%.2f; %s,", kReductionLoadFactors[il], kBucketReductionNames[ir]);
+			for (size_t ia = 0; ia < g_Results.size(); ++ia)
+			{
+				const std::vector<float>& increase = g_Results[ia].datasets[dataIndex].reductionCollisionsIncrease;
+				if (increase.empty())
+					fprintf(g_OutputFile, ",");
+				else
+					fprintf(g_OutputFile, "%.1f,", increase[il * kReductionCount + ir]);
+			}
+			fprintf(g_OutputFile, "\n");
+		}
+	}
+}
+
+static void PrintResults()
+{
+	if (g_RunQuality)
+		fprintf(g_OutputFile, "**** Quality evaluation\n");
+	for (size_t id = 0; id < g_DataSets.size() && g_RunQuality; ++id)
+	{
+		const DataSet& data = *g_DataSets[id];
+		fprintf(g_OutputFile, "%s, %i entries, %.1f MB size, avg length %.1f\n", data.name.c_str(), (int)data.GetEntryCount(), data.totalSize / 1024.0 / 1024.0, double(data.totalSize) / data.GetEntryCount());
+		fprintf(g_OutputFile, "HashAlgorithm   Colis HTColsIncrease hashsum\n");
+		for (size_t ia = 0; ia < g_Results.size(); ++ia)
+		{
+			const Result::DataSetResult& res = g_Results[ia].datasets[id];
+			fprintf(g_OutputFile, "%15s %4i %6i           %08x", g_Results[ia].name.c_str(), res.collisions, (int)res.hashtabCollisionsIncrease, res.hashsum);
+			if (res.collisionsError > 0)
+				fprintf(g_OutputFile, " (estimated, std. error: colis %.0f, HTColsIncrease %.1f)", res.collisionsError, res.hashtabCollisionsIncreaseError);
+			fprintf(g_OutputFile, "\n");
+		}
+		PrintReductionTable(id);
+	}
+	if (g_RunQuality && g_RunReductionSweep)
+	{
+		fprintf(g_OutputFile, "Bucket reduction cost alone, ns/reduction\nHashBits,");
+		for (int ir = 0; ir < kReductionCount; ++ir)
+			fprintf(g_OutputFile, "%s,", kBucketReductionNames[ir]);
+		fprintf(g_OutputFile, "\n");
+		for (int ib = 0; ib < 2; ++ib)
+		{
+			fprintf(g_OutputFile, "%i,", ib ? 64 : 32);
+			for (int ir = 0; ir < kReductionCount; ++ir)
+				fprintf(g_OutputFile, "%.2f,", g_ReductionNsPerHash[ib][ir]);
+			fprintf(g_OutputFile, "\n");
+		}
+	}
+
+	if (!g_RunPerf)
+		return;
+	PrintPerfTable("\n**** Performance evaluation, MB/s\n", GetPerfMBPS, "%.0f,");
+	PrintPerfTable("\n**** Aligned data performance evaluation, MB/s\n", GetPerfMBPSAligned, "%.0f,");
+	PrintPerfTable("\n**** Performance evaluation, median MB/s over iterations\n", GetPerfMBPSMedian, "%.0f,");
+	PrintPerfTable("\n**** Performance evaluation, width of median MB/s 95% confidence interval, % of median\n", GetPerfMBPSCIWidth, "%.1f,");
+	if (g_RunLatency)
+	{
+		PrintPerfTable("\n**** Throughput, ns/hash (independent hashes)\n", GetPerfNsPerHash, "%.2f,");
+		PrintPerfTable("\n**** Latency, ns/hash (each hash input depends on the previous hash)\n", GetPerfLatencyNsPerHash, "%.2f,");
+	}
+#	if PLATFORM_HAS_CYCLE_COUNTER
+	char title[128];
+	snprintf(title, sizeof(title), "\n**** Performance evaluation, cycles/hash (TSC at %.0f MHz)\n", TimerCyclesPerSecond() / 1.0e6);
+	PrintPerfTable(title, GetPerfCyclesPerHash, "%.1f,");
+	PrintPerfTable("\n**** Performance evaluation, cycles/byte\n", GetPerfCyclesPerByte, "%.2f,");
+#	endif
+	PrintPerfCliffs();
+	PrintKeyMixTables();
+	PrintHashTableTables();
+	PrintCuckooTables();
+	PrintBloomTables();
+	PrintOffsetTables();
+	PrintWorkingSetTables();
+	PrintScalingTables();
+	if (g_PerfCounterGroup.IsOpen())
+	{
+		PrintPerfTable("\n**** Hardware counters, instructions per cycle\n", GetPerfIPC, "%.2f,");
+		PrintPerfTable("\n**** Hardware counters, branch misses, % of branches\n", GetPerfBranchMissRate, "%.2f,");
+		PrintPerfTable("\n**** Hardware counters, instructions/byte\n", GetPerfInstructionsPerByte, "%.2f,");
+		PrintPerfTable("\n**** Hardware counters, L1D read misses/hash\n", GetPerfL1DMissesPerHash, "%.3f,");
+		PrintPerfTable("\n**** Hardware counters, uops retired/hash\n", GetPerfUopsPerHash, "%.1f,");
+	}
+}
+
+
+// ------------------------------------------------------------------------------------
+// Running performance tests: a fixed number of iterations, or in adaptive mode, at least
+// that many and then more for hash functions whose MB/s confidence intervals are still wide.
+
+static float g_PerfTargetCI = 0; // target 95% CI width of median MB/s, % of the median; 0 = fixed iteration count
+static int g_PerfMaxIterations = 100; // adaptive mode upper limit
+
+static bool IsPerfConverged(const Result& res, bool aligned)
+{
+	SampleStats stats;
+	for (size_t is = 0; is < res.mbpsPerLength.size(); ++is)
+	{
+		const Result::PerfResult& p = res.mbpsPerLength[is];
+		ComputeSampleStats(aligned ? p.mbpsAlignedSamples : p.mbpsSamples, stats);
+		if (stats.GetRelativeCIWidth() > g_PerfTargetCI)
+			return false;
+	}
+	return true;
+}
+
+static void RunPerfIterations(bool aligned)
+{
+	const int maxIterations = g_PerfTargetCI > 0 ? std::max(g_PerfMaxIterations, g_PerfIterations) : g_PerfIterations;
+	std::vector<size_t> toTest;
+	for (int iter = 0; iter < maxIterations; ++iter)
+	{
+		toTest.clear();
+		for (size_t i = 0; i < g_Hashes.size(); ++i)
+		{
+			if (g_Hashes[i].excludeFromPerf)
+				continue;
+			if (iter >= g_PerfIterations && IsPerfConverged(g_Results[i], aligned))
+				continue;
+			toTest.push_back(i);
+		}
+		if (toTest.empty())
+			break;
+		if (iter < g_PerfIterations)
+			fprintf(g_OutputFile, "  iter %i/%i\n", iter+1, g_PerfIterations);
+		else
+			fprintf(g_OutputFile, "  iter %i, %i hash functions above %.1f%% CI width\n", iter+1, (int)toTest.size(), g_PerfTargetCI);
+		for (size_t i = 0; i < toTest.size(); ++i)
+			g_Hashes[toTest[i]].perfFunc(g_SyntheticData, aligned, g_Results[toTest[i]]);
+	}
+}
+
+static void RunWorkingSetSweep()
+{
+	for (size_t iw = 0; iw < g_WorkingSetSizes.size(); ++iw)
+	{
+		WorkingSetBuffer buffer;
+		if (!buffer.Allocate(g_WorkingSetSizes[iw], g_WorkingSetHugePages))
+		{
+			fprintf(g_OutputFile, "error: can't allocate %llu byte working set\n", (unsigned long long)g_WorkingSetSizes[iw]);
+			continue;
+		}
+		fprintf(g_OutputFile, "  working set %s%s...\n", FormatByteSize(buffer.size).c_str(),
+			buffer.hugePages ? ", 2MB pages" : buffer.transparentHugePages ? ", transparent huge pages" : "");
+		if (g_WorkingSetHugePages && !buffer.hugePages && !buffer.transparentHugePages)
+			fprintf(g_OutputFile, "warning: huge pages not available, using regular pages\n");
+		for (int iter = 0; iter < g_PerfIterations; ++iter)
+		{
+			for (size_t i = 0; i < g_Hashes.size(); ++i)
+			{
+				if (!g_Hashes[i].excludeFromPerf)
+					g_Hashes[i].workingSetFunc(buffer, iw, g_Results[i]);
+			}
+		}
+	}
+}
+
+#if SCALING_TEST
+static void AllocateBufferTask(WorkingSetBuffer* buffer, int cpu, bool* outOk)
+{
+	SetAffinity(cpu);
+	*outOk = buffer->Allocate(g_ScalingBufferSize, false);
+}
+
+static void RunScalingTest()
+{
+	// placement order of threads, and how many
+	std::vector<int> cpus;
+	cpus.resize(4096);
+	cpus.resize(GetCpuPlacementOrder(g_ScalingSmtSiblingsFirst, cpus.data(), (int)cpus.size()));
+	int maxThreads = g_ScalingMaxThreads;
+	if (maxThreads <= 0)
+		maxThreads = cpus.empty() ? (int)std::thread::hardware_concurrency() : (int)cpus.size();
+	if (maxThreads <= 0)
+		maxThreads = 1;
+	std::vector<int> threadCounts;
+	for (int n = 1; n < maxThreads; n *= 2)
+		threadCounts.push_back(n);
+	threadCounts.push_back(maxThreads);
+	if (cpus.empty())
+		fprintf(g_OutputFile, "warning: CPU topology not known, scaling test threads are not pinned\n");
+	else if (maxThreads > (int)cpus.size())
+		fprintf(g_OutputFile, "warning: more scaling test threads than CPUs, extra ones are not pinned\n");
+
+	// every thread touches its own buffer first
+	std::vector<WorkingSetBuffer> buffers(maxThreads);
+	std::vector<std::thread> allocators;
+	bool* allocated = new bool[maxThreads];
+	for (int i = 0; i < maxThreads; ++i)
+		allocators.push_back(std::thread(AllocateBufferTask, &buffers[i], i < (int)cpus.size() ? cpus[i] : -1, &allocated[i]));
+	bool ok = true;
+	for (int i = 0; i < maxThreads; ++i)
+	{
+		allocators[i].join();
+		ok &= allocated[i];
+	}
+	delete[] allocated;
+	if (!ok)
+	{
+		fprintf(g_OutputFile, "error: can't allocate scaling test buffers\n");
+		return;
+	}
+
+	for (size_t ic = 0; ic < threadCounts.size(); ++ic)
+	{
+		fprintf(g_OutputFile, "  %i threads...\n", threadCounts[ic]);
+		for (int iter = 0; iter < g_PerfIterations; ++iter)
+		{
+			for (size_t i = 0; i < g_Hashes.size(); ++i)
+			{
+				if (!g_Hashes[i].excludeFromPerf)
+					g_Hashes[i].scalingFunc(buffers, cpus, threadCounts[ic], ic, g_Results[i]);
+			}
+		}
+	}
+}
+#endif // #if SCALING_TEST
+
+static void ComputePerfStats()
+{
+	for (size_t ia = 0; ia < g_Results.size(); ++ia)
+	{
+		for (size_t is = 0; is < g_Results[ia].mbpsPerLength.size(); ++is)
+		{
+			Result::PerfResult& p = g_Results[ia].mbpsPerLength[is];
+			ComputeSampleStats(p.mbpsSamples, p.mbpsStats);
+			ComputeSampleStats(p.mbpsAlignedSamples, p.mbpsAlignedStats);
+		}
+	}
+}
+
+
+// ------------------------------------------------------------------------------------
+// Structured result output: JSON, and "long format" CSV with one value per row
+
+static std::string g_JsonOutputPath; // empty = don't write; "-" = stdout
+static std::string g_CsvOutputPath;
+
+static const char* GetCollisionEngineName()
+{
+	switch (g_CollisionEngine)
+	{
+	case kCollisionEngineSet: return "set";
+	case kCollisionEngineEstimate: return "estimate";
+	default: return "sort";
+	}
+}
+
+static FILE* OpenOutputFile(const std::string& path)
+{
+	if (path == "-")
+		return stdout;
+	FILE* f = fopen(path.c_str(), "wb");
+	if (!f)
+		fprintf(g_OutputFile, "error: can't write results file '%s'\n", path.c_str());
+	return f;
+}
+
+static void CloseOutputFile(FILE* f)
+{
+	if (f != stdout)
+		fclose(f);
+	else
+		fflush(f);
+}
+
+static void WriteJsonString(FILE* f, const std::string& str)
+{
+	fputc('"', f);
+	for (size_t i = 0; i < str.size(); ++i)
+	{
+		unsigned char c = (unsigned char)str[i];
+		if (c == '"' || c == '\\')
+			fprintf(f, "\\%c", c);
+		else if (c < 0x20)
+			fprintf(f, "\\u%04x", c);
+		else
+			fputc(c, f);
+	}
+	fputc('"', f);
+}
+
+static void WriteJsonNumber(FILE* f, double value)
+{
+	if (isfinite(value))
+		fprintf(f, "%.9g", value);
+	else
+		fprintf(f, "null");
+}
+
+static void WriteJsonStats(FILE* f, const SampleStats& st)
+{
+	fprintf(f, "{ \"count\": %i, \"min\": ", st.count);
+	WriteJsonNumber(f, st.min);
+	fprintf(f, ", \"max\": "); WriteJsonNumber(f, st.max);
+	fprintf(f, ", \"mean\": "); WriteJsonNumber(f, st.mean);
+	fprintf(f, ", \"median\": "); WriteJsonNumber(f, st.median);
+	fprintf(f, ", \"p90\": "); WriteJsonNumber(f, st.p90);
+	fprintf(f, ", \"stddev\": "); WriteJsonNumber(f, st.stddev);
+	fprintf(f, ", \"ciLow\": "); WriteJsonNumber(f, st.ciLow);
+	fprintf(f, ", \"ciHigh\": "); WriteJsonNumber(f, st.ciHigh);
+	fprintf(f, " }");
+}
+
+static void WriteJsonArray(FILE* f, const std::vector<float>& values)
+{
+	fprintf(f, "[");
+	for (size_t i = 0; i < values.size(); ++i)
+	{
+		if (i)
+			fprintf(f, ", ");
+		WriteJsonNumber(f, values[i]);
+	}
+	fprintf(f, "]");
+}
+
+// ",\n      "bloomFilters": [ ... ]" of one hash function's Result or Result128
+static void WriteJsonBloomFilters(FILE* f, const std::vector<Result::BloomFilterResult>& filters)
+{
+	fprintf(f, ",\n      \"bloomFilters\": [");
+	bool first = true;
+	for (size_t id = 0; id < filters.size(); ++id)
+	{
+		const Result::BloomFilterResult& b = filters[id];
+		if (g_DataSetKeys[id].size() < 2)
+			continue;
+		fprintf(f, "%s\n        { \"dataset\": ", first ? "" : ",");
+		first = false;
+		WriteJsonString(f, g_DataSets[id]->name);
+		fprintf(f, ", \"keys\": %llu, \"bitsPerKey\": %i, \"probes\": %i", (unsigned long long)g_DataSetKeys[id].size(), (int)kBloomBitsPerKey, kBloomProbeCount);
+		fprintf(f, ", \"separateQps\": "); WriteJsonNumber(f, b.separateQps);
+		fprintf(f, ", \"separateBatchQps\": "); WriteJsonNumber(f, b.separateBatchQps);
+		fprintf(f, ", \"doubleQps\": "); WriteJsonNumber(f, b.doubleQps);
+		fprintf(f, ", \"doubleBatchQps\": "); WriteJsonNumber(f, b.doubleBatchQps);
+		fprintf(f, ", \"separateFalsePositiveRate\": "); WriteJsonNumber(f, b.separateFalsePositiveRate);
+		fprintf(f, ", \"doubleFalsePositiveRate\": "); WriteJsonNumber(f, b.doubleFalsePositiveRate);
+		fprintf(f, ", \"expectedFalsePositiveRate\": "); WriteJsonNumber(f, b.expectedFalsePositiveRate);
+		fprintf(f, " }");
+	}
+	fprintf(f, "\n      ]");
+}
+
+static void WriteJsonResults(FILE* f, const RunInfo& info)
+{
+	fprintf(f, "{\n  \"run\": {\n");
+	fprintf(f, "    \"cpuModel\": "); WriteJsonString(f, info.cpuModel);
+	fprintf(f, ",\n    \"cpuFlags\": "); WriteJsonString(f, info.cpuFlags);
+	fprintf(f, ",\n    \"governor\": "); WriteJsonString(f, info.governor);
+	fprintf(f, ",\n    \"compiler\": "); WriteJsonString(f, info.compiler);
+	fprintf(f, ",\n    \"compileFlags\": "); WriteJsonString(f, info.compileFlags);
+	fprintf(f, ",\n    \"gitRevision\": "); WriteJsonString(f, info.gitRevision);
+	fprintf(f, ",\n    \"timestamp\": "); WriteJsonString(f, info.timestamp);
+	fprintf(f, ",\n    \"perfIterations\": %i", g_RunPerf ? g_PerfIterations : 0);
+	fprintf(f, ",\n    \"collisionEngine\": \"%s\"", GetCollisionEngineName());
+	if (g_RunQuality && g_RunReductionSweep)
+	{
+		fprintf(f, ",\n    \"reductionNsPerHash\": {");
+		for (int ib = 0; ib < 2; ++ib)
+		{
+			fprintf(f, "%s \"%i\": {", ib ? "," : "", ib ? 64 : 32);
+			for (int ir = 0; ir < kReductionCount; ++ir)
+			{
+				fprintf(f, "%s \"%s\": ", ir ? "," : "", kBucketReductionNames[ir]);
+				WriteJsonNumber(f, g_ReductionNsPerHash[ib][ir]);
+			}
+			fprintf(f, " }");
+		}
+		fprintf(f, " }");
+	}
+	fprintf(f, ",\n    \"workingSetHugePages\": %s", g_WorkingSetHugePages ? "true" : "false");
+#	if PLATFORM_HAS_CYCLE_COUNTER
+	fprintf(f, ",\n    \"cyclesPerSecond\": %.0f", TimerCyclesPerSecond());
+#	endif
+	fprintf(f, "\n  },\n  \"datasets\": [");
+	const size_t dataSetCount = g_RunQuality ? g_DataSets.size() : 0;
+	for (size_t id = 0; id < dataSetCount; ++id)
+	{
+		const DataSet& data = *g_DataSets[id];
+		fprintf(f, "%s\n    { \"name\": ", id ? "," : "");
+		WriteJsonString(f, data.name);
+		fprintf(f, ", \"entries\": %llu, \"totalSize\": %llu }", (unsigned long long)data.GetEntryCount(), (unsigned long long)data.totalSize);
+	}
+	fprintf(f, "%s],\n  \"results\": [", dataSetCount ? "\n  " : "");
+	for (size_t ia = 0; ia < g_Results.size(); ++ia)
+	{
+		const Result& res = g_Results[ia];
+		fprintf(f, "%s\n    {\n      \"name\": ", ia ? "," : "");
+		WriteJsonString(f, res.name);
+		fprintf(f, ",\n      \"quality\": [");
+		for (size_t id = 0; id < dataSetCount; ++id)
+		{
+			const Result::DataSetResult& q = res.datasets[id];
+			fprintf(f, "%s\n        { \"dataset\": ", id ? "," : "");
+			WriteJsonString(f, g_DataSets[id]->name);
+			fprintf(f, ", \"hashsum\": \"%08x\", \"collisions\": %i, \"hashtabCollisionsIncrease\": ", q.hashsum, q.collisions);
+			WriteJsonNumber(f, q.hashtabCollisionsIncrease);
+			fprintf(f, ", \"collisionsError\": ");
+			WriteJsonNumber(f, q.collisionsError);
+			fprintf(f, ", \"hashtabCollisionsIncreaseError\": ");
+			WriteJsonNumber(f, q.hashtabCollisionsIncreaseError);
+			if (!q.reductionCollisionsIncrease.empty())
+			{
+				const size_t entryCount = g_DataSets[id]->GetEntryCount();
+				fprintf(f, ",\n          \"reductions\": [");
+				for (int il = 0; il < kReductionLoadFactorCount; ++il)
+				{
+					for (int ir = 0; ir < kReductionCount; ++ir)
+					{
+						fprintf(f, "%s\n            { \"loadFactor\": ", il || ir ? "," : "");
+						WriteJsonNumber(f, kReductionLoadFactors[il]);
+						fprintf(f, ", \"reduction\": \"%s\", \"tableSize\": %llu, \"hashtabCollisionsIncrease\": ", kBucketReductionNames[ir],
+							(unsigned long long)GetReductionTableSize((BucketReduction)ir, entryCount, kReductionLoadFactors[il]));
+						WriteJsonNumber(f, q.reductionCollisionsIncrease[il * kReductionCount + ir]);
+						fprintf(f, " }");
+					}
+				}
+				fprintf(f, " ]");
+			}
+			fprintf(f, " }");
+		}
+		fprintf(f, "%s],\n      \"perf\": [", dataSetCount ? "\n      " : "");
+		for (size_t is = 0; is < res.mbpsPerLength.size(); ++is)
+		{
+			const Result::PerfResult& p = res.mbpsPerLength[is];
+			fprintf(f, "%s\n        { \"length\": %i, \"mbps\": %i, \"mbpsAligned\": %i, \"cyclesPerHash\": ", is ? "," : "", p.length, p.mbps, p.mbpsAligned);
+			WriteJsonNumber(f, p.cyclesPerHash);
+			fprintf(f, ", \"cyclesPerByte\": ");
+			WriteJsonNumber(f, p.cyclesPerByte);
+			fprintf(f, ", \"nsPerHash\": ");
+			WriteJsonNumber(f, p.nsPerHash);
+			if (g_RunLatency)
+			{
+				fprintf(f, ", \"latencyNsPerHash\": ");
+				WriteJsonNumber(f, p.latencyNsPerHash);
+			}
+			fprintf(f, ",\n          \"mbpsStats\": ");
+			WriteJsonStats(f, p.mbpsStats);
+			fprintf(f, ",\n          \"mbpsAlignedStats\": ");
+			WriteJsonStats(f, p.mbpsAlignedStats);
+			fprintf(f, ",\n          \"mbpsSamples\": ");
+			WriteJsonArray(f, p.mbpsSamples);
+			fprintf(f, ", \"mbpsAlignedSamples\": ");
+			WriteJsonArray(f, p.mbpsAlignedSamples);
+			if (p.counters.Has(kPerfCounterCycles))
+			{
+				fprintf(f, ",\n          \"counters\": { ");
+				for (int i = 0; i < kPerfCounterCount; ++i)
+				{
+					if (!p.counters.Has(i))
+						continue;
+					fprintf(f, "\"%sPerHash\": ", kPerfCounterNames[i]);
+					WriteJsonNumber(f, p.counters.values[i]);
+					fprintf(f, ", ");
+				}
+				fprintf(f, "\"ipc\": "); WriteJsonNumber(f, GetPerfIPC(p));
+				fprintf(f, ", \"branchMissRate\": "); WriteJsonNumber(f, GetPerfBranchMissRate(p));
+				fprintf(f, ", \"instructionsPerByte\": "); WriteJsonNumber(f, GetPerfInstructionsPerByte(p));
+				fprintf(f, " }");
+			}
+			fprintf(f, " }");
+		}
+		fprintf(f, "%s]", res.mbpsPerLength.empty() ? "" : "\n      ");
+		std::vector<PerfCliff> cliffs;
+		FindPerfCliffs(res, cliffs);
+		if (!res.mbpsPerLength.empty())
+		{
+			fprintf(f, ",\n      \"cliffs\": [");
+			for (size_t i = 0; i < cliffs.size(); ++i)
+			{
+				fprintf(f, "%s{ \"fromLength\": %i, \"toLength\": %i, \"drop\": ", i ? ", " : "", cliffs[i].fromLength, cliffs[i].toLength);
+				WriteJsonNumber(f, cliffs[i].drop);
+				fprintf(f, " }");
+			}
+			fprintf(f, "]");
+		}
+		if (!res.keyMixes.empty())
+		{
+			fprintf(f, ",\n      \"keyMixes\": [");
+			for (size_t im = 0; im < res.keyMixes.size(); ++im)
+			{
+				fprintf(f, "%s\n        { \"name\": ", im ? "," : "");
+				WriteJsonString(f, g_KeyMixes[im].name);
+				fprintf(f, ", \"keys\": %llu, \"bytes\": %llu, \"keysPerSec\": ", (unsigned long long)g_KeyMixes[im].keyCount, (unsigned long long)g_KeyMixes[im].totalBytes);
+				WriteJsonNumber(f, res.keyMixes[im].keysPerSec);
+				fprintf(f, ", \"mbps\": ");
+				WriteJsonNumber(f, res.keyMixes[im].mbps);
+				fprintf(f, " }");
+			}
+			fprintf(f, "\n      ]");
+		}
+		if (!res.hashTables.empty())
+		{
+			fprintf(f, ",\n      \"hashTables\": [");
+			bool first = true;
+			for (size_t id = 0; id < res.hashTables.size(); ++id)
+			{
+				const Result::HashTableResult& t = res.hashTables[id];
+				if (g_DataSetKeys[id].size() < 2)
+					continue;
+				fprintf(f, "%s\n        { \"dataset\": ", first ? "" : ",");
+				first = false;
+				WriteJsonString(f, g_DataSets[id]->name);
+				fprintf(f, ", \"keys\": %llu, \"loadFactor\": ", (unsigned long long)g_DataSetKeys[id].size());
+				WriteJsonNumber(f, t.loadFactor);
+				fprintf(f, ", \"insertNs\": "); WriteJsonNumber(f, t.insertNs);
+				fprintf(f, ", \"hitNs\": "); WriteJsonNumber(f, t.hitNs);
+				fprintf(f, ", \"missNs\": "); WriteJsonNumber(f, t.missNs);
+				fprintf(f, ", \"insertProbesAvg\": "); WriteJsonNumber(f, t.insertProbesAvg);
+				fprintf(f, ", \"hitProbesAvg\": "); WriteJsonNumber(f, t.hitProbesAvg);
+				fprintf(f, ", \"hitProbesMax\": %i, \"missProbesAvg\": ", t.hitProbesMax);
+				WriteJsonNumber(f, t.missProbesAvg);
+				fprintf(f, ", \"missProbesMax\": %i }", t.missProbesMax);
+			}
+			fprintf(f, "\n      ]");
+		}
+		if (!res.swissTables.empty())
+		{
+			fprintf(f, ",\n      \"swissTables\": [");
+			bool first = true;
+			for (size_t id = 0; id < res.swissTables.size(); ++id)
+			{
+				const Result::SwissTableResult& t = res.swissTables[id];
+				if (g_DataSetKeys[id].size() < 2)
+					continue;
+				fprintf(f, "%s\n        { \"dataset\": ", first ? "" : ",");
+				first = false;
+				WriteJsonString(f, g_DataSets[id]->name);
+				fprintf(f, ", \"keys\": %llu, \"loadFactor\": ", (unsigned long long)g_DataSetKeys[id].size());
+				WriteJsonNumber(f, t.loadFactor);
+				fprintf(f, ", \"insertNs\": "); WriteJsonNumber(f, t.insertNs);
+				fprintf(f, ", \"hitNs\": "); WriteJsonNumber(f, t.hitNs);
+				fprintf(f, ", \"missNs\": "); WriteJsonNumber(f, t.missNs);
+				fprintf(f, ", \"hitGroupsAvg\": "); WriteJsonNumber(f, t.hitGroupsAvg);
+				fprintf(f, ", \"missGroupsAvg\": "); WriteJsonNumber(f, t.missGroupsAvg);
+				fprintf(f, ", \"falseMatchesPerLookup\": "); WriteJsonNumber(f, t.falseMatchesPerLookup);
+				fprintf(f, ", \"falseMatchRate\": "); WriteJsonNumber(f, t.falseMatchRate);
+				fprintf(f, " }");
+			}
+			fprintf(f, "\n      ]");
+		}
+		if (!res.bloomFilters.empty())
+			WriteJsonBloomFilters(f, res.bloomFilters);
+		if (!res.robinHood.empty())
+		{
+			fprintf(f, ",\n      \"robinHood\": [");
+			bool first = true;
+			for (size_t id = 0; id < res.robinHood.size(); ++id)
+			{
+				const std::vector<Result::RobinHoodResult>& loads = res.robinHood[id];
+				if (loads.empty())
+					continue;
+				fprintf(f, "%s\n        { \"dataset\": ", first ? "" : ",");
+				first = false;
+				WriteJsonString(f, g_DataSets[id]->name);
+				fprintf(f, ", \"capacity\": %llu, \"loadFactors\": [", (unsigned long long)GetRobinHoodCapacity(g_DataSetKeys[id].size()));
+				bool firstLoad = true;
+				for (size_t il = 0; il < loads.size(); ++il)
+				{
+					const Result::RobinHoodResult& t = loads[il];
+					if (t.loadFactor == 0)
+						continue;
+					fprintf(f, "%s\n          { \"loadFactor\": ", firstLoad ? "" : ",");
+					firstLoad = false;
+					WriteJsonNumber(f, t.loadFactor);
+					fprintf(f, ", \"insertNs\": "); WriteJsonNumber(f, t.insertNs);
+					fprintf(f, ", \"hitNs\": "); WriteJsonNumber(f, t.hitNs);
+					fprintf(f, ", \"missNs\": "); WriteJsonNumber(f, t.missNs);
+					fprintf(f, ", \"hitProbesMean\": "); WriteJsonNumber(f, t.hitProbesMean);
+					fprintf(f, ", \"hitProbesP99\": %i, \"hitProbesMax\": %i, \"missProbesMean\": ", t.hitProbesP99, t.hitProbesMax);
+					WriteJsonNumber(f, t.missProbesMean);
+					fprintf(f, ", \"missProbesP99\": %i, \"missProbesMax\": %i }", t.missProbesP99, t.missProbesMax);
+				}
+				fprintf(f, "\n        ] }");
+			}
+			fprintf(f, "\n      ]");
+		}
+		if (!res.offsets.empty())
+		{
+			fprintf(f, ",\n      \"offsets\": [");
+			for (size_t io = 0; io < res.offsets.size(); ++io)
+			{
+				const Result::OffsetResult& o = res.offsets[io];
+				fprintf(f, "%s\n        { \"offset\": ", io ? "," : "");
+				if (o.offset == kOffsetPageStraddle)
+					fprintf(f, "\"page\"");
+				else
+					fprintf(f, "%i", o.offset);
+				fprintf(f, ", \"mbps\": [");
+				for (size_t is = 0; is < o.mbpsPerLength.size(); ++is)
+				{
+					fprintf(f, "%s{ \"length\": %i, \"mbps\": ", is ? ", " : "", g_PerfLengths[is]);
+					WriteJsonNumber(f, o.mbpsPerLength[is]);
+					fprintf(f, " }");
+				}
+				fprintf(f, "] }");
+			}
+			fprintf(f, "\n      ]");
+		}
+		if (!res.scaling.empty())
+		{
+			fprintf(f, ",\n      \"scaling\": [");
+			for (size_t ic = 0; ic < res.scaling.size(); ++ic)
+			{
+				const Result::ScalingResult& sc = res.scaling[ic];
+				fprintf(f, "%s\n        { \"threads\": %i, \"mbps\": [", ic ? "," : "", sc.threads);
+				for (size_t is = 0; is < sc.mbpsPerLength.size(); ++is)
+				{
+					const float single = res.scaling[0].mbpsPerLength[is];
+					fprintf(f, "%s{ \"length\": %i, \"mbps\": ", is ? ", " : "", g_PerfLengths[is]);
+					WriteJsonNumber(f, sc.mbpsPerLength[is]);
+					fprintf(f, ", \"efficiency\": ");
+					WriteJsonNumber(f, single > 0 ? sc.mbpsPerLength[is] / (single * sc.threads) : 0.0);
+					fprintf(f, " }");
+				}
+				fprintf(f, "] }");
+			}
+			fprintf(f, "\n      ]");
+		}
+		if (!res.workingSets.empty())
+		{
+			fprintf(f, ",\n      \"workingSets\": [");
+			for (size_t iw = 0; iw < res.workingSets.size(); ++iw)
+			{
+				const Result::WorkingSetResult& ws = res.workingSets[iw];
+				fprintf(f, "%s\n        { \"size\": %llu, \"mbps\": [", iw ? "," : "", (unsigned long long)ws.size);
+				for (size_t is = 0; is < ws.mbpsPerLength.size(); ++is)
+				{
+					fprintf(f, "%s{ \"length\": %i, \"mbps\": ", is ? ", " : "", g_PerfLengths[is]);
+					WriteJsonNumber(f, ws.mbpsPerLength[is]);
+					fprintf(f, " }");
+				}
+				fprintf(f, "] }");
+			}
+			fprintf(f, "\n      ]");
+		}
+		fprintf(f, "\n    }");
+	}
+	fprintf(f, "\n  ]");
+	if (!g_Results128.empty())
+	{
+		fprintf(f, ",\n  \"results128\": [");
+		for (size_t ia = 0; ia < g_Results128.size(); ++ia)
+		{
+			const Result128& res = g_Results128[ia];
+			fprintf(f, "%s\n    {\n      \"name\": ", ia ? "," : "");
+			WriteJsonString(f, res.name);
+			fprintf(f, ",\n      \"hashsum\": \"%08x\"", res.hashsum);
+			if (!res.bloomFilters.empty())
+				WriteJsonBloomFilters(f, res.bloomFilters);
+			if (res.cuckooTables.empty())
+			{
+				fprintf(f, "\n    }");
+				continue;
+			}
+			fprintf(f, ",\n      \"cuckoo\": [");
+			bool first = true;
+			for (size_t id = 0; id < res.cuckooTables.size(); ++id)
+			{
+				const Result128::CuckooTableResult& t = res.cuckooTables[id];
+				const Result128::CuckooFilterResult& fl = res.cuckooFilters[id];
+				if (t.loadFactor == 0)
+					continue;
+				fprintf(f, "%s\n        { \"dataset\": ", first ? "" : ",");
+				first = false;
+				WriteJsonString(f, g_DataSets[id]->name);
+				fprintf(f, ", \"capacity\": %llu, \"table\": { \"loadFactor\": ", (unsigned long long)GetCuckooCapacity(g_DataSetKeys[id].size()));
+				WriteJsonNumber(f, t.loadFactor);
+				fprintf(f, ", \"insertNs\": "); WriteJsonNumber(f, t.insertNs);
+				fprintf(f, ", \"hitNs\": "); WriteJsonNumber(f, t.hitNs);
+				fprintf(f, ", \"missNs\": "); WriteJsonNumber(f, t.missNs);
+				fprintf(f, ", \"kicksMean\": "); WriteJsonNumber(f, t.kicksMean);
+				fprintf(f, ", \"kicksMax\": %i }, \"filter\": { \"loadFactor\": ", t.kicksMax);
+				WriteJsonNumber(f, fl.loadFactor);
+				fprintf(f, ", \"insertNs\": "); WriteJsonNumber(f, fl.insertNs);
+				fprintf(f, ", \"hitNs\": "); WriteJsonNumber(f, fl.hitNs);
+				fprintf(f, ", \"missNs\": "); WriteJsonNumber(f, fl.missNs);
+				fprintf(f, ", \"kicksMean\": "); WriteJsonNumber(f, fl.kicksMean);
+				fprintf(f, ", \"kicksMax\": %i, \"falsePositiveRate\": ", fl.kicksMax);
+				WriteJsonNumber(f, fl.falsePositiveRate);
+				fprintf(f, ", \"expectedFalsePositiveRate\": "); WriteJsonNumber(f, fl.expectedFalsePositiveRate);
+				fprintf(f, " } }");
+			}
+			fprintf(f, "\n      ]\n    }");
+		}
+		fprintf(f, "\n  ]");
+	}
+	fprintf(f, "\n}\n");
+}
+
+static void WriteCsvField(FILE* f, const std::string& str)
+{
+	if (str.find_first_of(",\"\r\n") == std::string::npos)
+	{
+		fputs(str.c_str(), f);
+		return;
+	}
+	fputc('"', f);
+	for (size_t i = 0; i < str.size(); ++i)
+	{
+		if (str[i] == '"')
+			fputc('"', f);
+		fputc(str[i], f);
+	}
+	fputc('"', f);
+}
+
+// one row: run info columns, then hash,test,dataset,length,metric,value
+static void WriteCsvRow(FILE* f, const RunInfo& info, const std::string& hash, const char* test, const std::string& dataset, int length, const char* metric, const char* value)
+{
+	const std::string* runFields[] = { &info.cpuModel, &info.cpuFlags, &info.governor, &info.compiler, &info.compileFlags, &info.gitRevision, &info.timestamp, &hash };
+	for (size_t i = 0; i < sizeof(runFields)/sizeof(runFields[0]); ++i)
+	{
+		WriteCsvField(f, *runFields[i]);
+		fputc(',', f);
+	}
+	fprintf(f, "%s,", test);
+	WriteCsvField(f, dataset);
+	if (length >= 0)
+		fprintf(f, ",%i,%s,%s\n", length, metric, value);
+	else
+		fprintf(f, ",,%s,%s\n", metric, value);
+}
+
+static void WriteCsvNumber(FILE* f, const RunInfo& info, const std::string& hash, const char* test, const std::string& dataset, int length, const char* metric, double value)
+{
+	char buf[32];
+	if (isfinite(value))
+		snprintf(buf, sizeof(buf), "%.9g", value);
+	else
+		buf[0] = 0;
+	WriteCsvRow(f, info, hash, test, dataset, length, metric, buf);
+}
+
+static void WriteCsvStats(FILE* f, const RunInfo& info, const std::string& hash, int length, const char* prefix, const SampleStats& st)
+{
+	const char* kNames[] = { "Min", "Max", "Mean", "Median", "P90", "Stddev", "CiLow", "CiHigh" };
+	const double values[] = { st.min, st.max, st.mean, st.median, st.p90, st.stddev, st.ciLow, st.ciHigh };
+	const std::string noDataSet;
+	for (size_t i = 0; i < sizeof(values)/sizeof(values[0]); ++i)
+	{
+		std::string metric = std::string(prefix) + kNames[i];
+		WriteCsvNumber(f, info, hash, "perf", noDataSet, length, metric.c_str(), values[i]);
+	}
+}
+
+static void WriteCsvBloomFilters(FILE* f, const RunInfo& info, const std::string& hash, const std::vector<Result::BloomFilterResult>& filters)
+{
+	for (size_t id = 0; id < filters.size(); ++id)
+	{
+		const Result::BloomFilterResult& b = filters[id];
+		if (g_DataSetKeys[id].size() < 2)
+			continue;
+		const std::string& name = g_DataSets[id]->name;
+		WriteCsvNumber(f, info, hash, "bloom", name, -1, "separateQps", b.separateQps);
+		WriteCsvNumber(f, info, hash, "bloom", name, -1, "separateBatchQps", b.separateBatchQps);
+		WriteCsvNumber(f, info, hash, "bloom", name, -1, "doubleQps", b.doubleQps);
+		WriteCsvNumber(f, info, hash, "bloom", name, -1, "doubleBatchQps", b.doubleBatchQps);
+		WriteCsvNumber(f, info, hash, "bloom", name, -1, "separateFalsePositiveRate", b.separateFalsePositiveRate);
+		WriteCsvNumber(f, info, hash, "bloom", name, -1, "doubleFalsePositiveRate", b.doubleFalsePositiveRate);
+		WriteCsvNumber(f, info, hash, "bloom", name, -1, "expectedFalsePositiveRate", b.expectedFalsePositiveRate);
+	}
+}
+
+static void WriteCsvResults(FILE* f, const RunInfo& info)
+{
+	fprintf(f, "cpu_model,cpu_flags,governor,compiler,compile_flags,git_revision,timestamp,hash,test,dataset,length,metric,value\n");
+	const std::string noDataSet;
+	const size_t dataSetCount = g_RunQuality ? g_DataSets.size() : 0;
+	for (size_t ia = 0; ia < g_Results.size(); ++ia)
+	{
+		const Result& res = g_Results[ia];
+		for (size_t id = 0; id < dataSetCount; ++id)
+		{
+			const Result::DataSetResult& q = res.datasets[id];
+			const std::string& name = g_DataSets[id]->name;
+			char hashsum[16];
+			snprintf(hashsum, sizeof(hashsum), "%08x", q.hashsum);
+			WriteCsvRow(f, info, res.name, "quality", name, -1, "hashsum", hashsum);
+			WriteCsvNumber(f, info, res.name, "quality", name, -1, "collisions", q.collisions);
+			WriteCsvNumber(f, info, res.name, "quality", name, -1, "hashtabCollisionsIncrease", q.hashtabCollisionsIncrease);
+			WriteCsvNumber(f, info, res.name, "quality", name, -1, "collisionsError", q.collisionsError);
+			WriteCsvNumber(f, info, res.name, "quality", name, -1, "hashtabCollisionsIncreaseError", q.hashtabCollisionsIncreaseError);
+			for (size_t i = 0; i < q.reductionCollisionsIncrease.size(); ++i)
+			{
+				// length column: load factor in %; metric: reduction name
+				const int load = (int)(kReductionLoadFactors[i / kReductionCount] * 100 + 0.5);
+				WriteCsvNumber(f, info, res.name, "reduction", name, load, kBucketReductionNames[i % kReductionCount], q.reductionCollisionsIncrease[i]);
+			}
+		}
+		std::vector<PerfCliff> cliffs;
+		FindPerfCliffs(res, cliffs);
+		for (size_t i = 0; i < cliffs.size(); ++i)
+		{
+			// length column: length after the drop; dataset column: length before it
+			char from[16];
+			snprintf(from, sizeof(from), "%i", cliffs[i].fromLength);
+			WriteCsvNumber(f, info, res.name, "cliff", from, cliffs[i].toLength, "mbpsDrop", cliffs[i].drop);
+		}
+		for (size_t im = 0; im < res.keyMixes.size(); ++im)
+		{
+			// dataset column: key mix name
+			WriteCsvNumber(f, info, res.name, "keymix", g_KeyMixes[im].name, -1, "keysPerSec", res.keyMixes[im].keysPerSec);
+			WriteCsvNumber(f, info, res.name, "keymix", g_KeyMixes[im].name, -1, "mbps", res.keyMixes[im].mbps);
+		}
+		for (size_t id = 0; id < res.hashTables.size(); ++id)
+		{
+			const Result::HashTableResult& t = res.hashTables[id];
+			const std::string& name = g_DataSets[id]->name;
+			if (g_DataSetKeys[id].size() < 2)
+				continue;
+			WriteCsvNumber(f, info, res.name, "hashtable", name, -1, "loadFactor", t.loadFactor);
+			WriteCsvNumber(f, info, res.name, "hashtable", name, -1, "insertNs", t.insertNs);
+			WriteCsvNumber(f, info, res.name, "hashtable", name, -1, "hitNs", t.hitNs);
+			WriteCsvNumber(f, info, res.name, "hashtable", name, -1, "missNs", t.missNs);
+			WriteCsvNumber(f, info, res.name, "hashtable", name, -1, "insertProbesAvg", t.insertProbesAvg);
+			WriteCsvNumber(f, info, res.name, "hashtable", name, -1, "hitProbesAvg", t.hitProbesAvg);
+			WriteCsvNumber(f, info, res.name, "hashtable", name, -1, "hitProbesMax", t.hitProbesMax);
+			WriteCsvNumber(f, info, res.name, "hashtable", name, -1, "missProbesAvg", t.missProbesAvg);
+			WriteCsvNumber(f, info, res.name, "hashtable", name, -1, "missProbesMax", t.missProbesMax);
+		}
+		for (size_t id = 0; id < res.swissTables.size(); ++id)
+		{
+			const Result::SwissTableResult& t = res.swissTables[id];
+			const std::string& name = g_DataSets[id]->name;
+			if (g_DataSetKeys[id].size() < 2)
+				continue;
+			WriteCsvNumber(f, info, res.name, "swisstable", name, -1, "loadFactor", t.loadFactor);
+			WriteCsvNumber(f, info, res.name, "swisstable", name, -1, "insertNs", t.insertNs);
+			WriteCsvNumber(f, info, res.name, "swisstable", name, -1, "hitNs", t.hitNs);
+			WriteCsvNumber(f, info, res.name, "swisstable", name, -1, "missNs", t.missNs);
+			WriteCsvNumber(f, info, res.name, "swisstable", name, -1, "hitGroupsAvg", t.hitGroupsAvg);
+			WriteCsvNumber(f, info, res.name, "swisstable", name, -1, "missGroupsAvg", t.missGroupsAvg);
+			WriteCsvNumber(f, info, res.name, "swisstable", name, -1, "falseMatchesPerLookup", t.falseMatchesPerLookup);
+			WriteCsvNumber(f, info, res.name, "swisstable", name, -1, "falseMatchRate", t.falseMatchRate);
+		}
+		WriteCsvBloomFilters(f, info, res.name, res.bloomFilters);
+		for (size_t id = 0; id < res.robinHood.size(); ++id)
+		{
+			// length column: load factor in %
+			const std::string& name = g_DataSets[id]->name;
+			for (size_t il = 0; il < res.robinHood[id].size(); ++il)
+			{
+				const Result::RobinHoodResult& t = res.robinHood[id][il];
+				if (t.loadFactor == 0)
+					continue;
+				const int load = (int)(kRobinHoodLoadFactors[il] * 100 + 0.5f);
+				WriteCsvNumber(f, info, res.name, "robinhood", name, load, "loadFactor", t.loadFactor);
+				WriteCsvNumber(f, info, res.name, "robinhood", name, load, "insertNs", t.insertNs);
+				WriteCsvNumber(f, info, res.name, "robinhood", name, load, "hitNs", t.hitNs);
+				WriteCsvNumber(f, info, res.name, "robinhood", name, load, "missNs", t.missNs);
+				WriteCsvNumber(f, info, res.name, "robinhood", name, load, "hitProbesMean", t.hitProbesMean);
+				WriteCsvNumber(f, info, res.name, "robinhood", name, load, "hitProbesP99", t.hitProbesP99);
+				WriteCsvNumber(f, info, res.name, "robinhood", name, load, "hitProbesMax", t.hitProbesMax);
+				WriteCsvNumber(f, info, res.name, "robinhood", name, load, "missProbesMean", t.missProbesMean);
+				WriteCsvNumber(f, info, res.name, "robinhood", name, load, "missProbesP99", t.missProbesP99);
+				WriteCsvNumber(f, info, res.name, "robinhood", name, load, "missProbesMax", t.missProbesMax);
+			}
+		}
+		for (size_t io = 0; io < res.offsets.size(); ++io)
+		{
+			// dataset column: key offset within cache line, or "page" for page straddling keys
+			const Result::OffsetResult& o = res.offsets[io];
+			char offset[16];
+			if (o.offset == kOffsetPageStraddle)
+				snprintf(offset, sizeof(offset), "page");
+			else
+				snprintf(offset, sizeof(offset), "%i", o.offset);
+			for (size_t is = 0; is < o.mbpsPerLength.size(); ++is)
+			{
+				if (o.mbpsPerLength[is] > 0)
+					WriteCsvNumber(f, info, res.name, "offset", offset, g_PerfLengths[is], "mbps", o.mbpsPerLength[is]);
+			}
+		}
+		for (size_t ic = 0; ic < res.scaling.size(); ++ic)
+		{
+			// dataset column: thread count
+			const Result::ScalingResult& sc = res.scaling[ic];
+			char threads[16];
+			snprintf(threads, sizeof(threads), "%i", sc.threads);
+			for (size_t is = 0; is < sc.mbpsPerLength.size(); ++is)
+			{
+				const float single = res.scaling[0].mbpsPerLength[is];
+				if (sc.mbpsPerLength[is] <= 0)
+					continue;
+				WriteCsvNumber(f, info, res.name, "scaling", threads, g_PerfLengths[is], "mbps", sc.mbpsPerLength[is]);
+				if (single > 0)
+					WriteCsvNumber(f, info, res.name, "scaling", threads, g_PerfLengths[is], "efficiency", sc.mbpsPerLength[is] / (single * sc.threads));
+			}
+		}
+		for (size_t iw = 0; iw < res.workingSets.size(); ++iw)
+		{
+			// dataset column: working set size in bytes
+			const Result::WorkingSetResult& ws = res.workingSets[iw];
+			char size[32];
+			snprintf(size, sizeof(size), "%llu", (unsigned long long)ws.size);
+			for (size_t is = 0; is < ws.mbpsPerLength.size(); ++is)
+			{
+				if (ws.mbpsPerLength[is] > 0)
+					WriteCsvNumber(f, info, res.name, "workingset", size, g_PerfLengths[is], "mbps", ws.mbpsPerLength[is]);
+			}
+		}
+		for (size_t is = 0; is < res.mbpsPerLength.size(); ++is)
+		{
+			const Result::PerfResult& p = res.mbpsPerLength[is];
+			WriteCsvNumber(f, info, res.name, "perf", noDataSet, p.length, "mbps", p.mbps);
+			WriteCsvNumber(f, info, res.name, "perf", noDataSet, p.length, "mbpsAligned", p.mbpsAligned);
+			WriteCsvNumber(f, info, res.name, "perf", noDataSet, p.length, "nsPerHash", p.nsPerHash);
+			if (g_RunLatency)
+				WriteCsvNumber(f, info, res.name, "perf", noDataSet, p.length, "latencyNsPerHash", p.latencyNsPerHash);
+			WriteCsvNumber(f, info, res.name, "perf", noDataSet, p.length, "mbpsSamples", p.mbpsStats.count);
+			WriteCsvStats(f, info, res.name, p.length, "mbps", p.mbpsStats);
+			WriteCsvStats(f, info, res.name, p.length, "mbpsAligned", p.mbpsAlignedStats);
+			if (p.counters.Has(kPerfCounterCycles))
+			{
+				for (int i = 0; i < kPerfCounterCount; ++i)
+				{
+					if (!p.counters.Has(i))
+						continue;
+					std::string metric = std::string(kPerfCounterNames[i]) + "PerHash";
+					WriteCsvNumber(f, info, res.name, "perf", noDataSet, p.length, metric.c_str(), p.counters.values[i]);
+				}
+				WriteCsvNumber(f, info, res.name, "perf", noDataSet, p.length, "ipc", GetPerfIPC(p));
+				WriteCsvNumber(f, info, res.name, "perf", noDataSet, p.length, "branchMissRate", GetPerfBranchMissRate(p));
+				WriteCsvNumber(f, info, res.name, "perf", noDataSet, p.length, "instructionsPerByte", GetPerfInstructionsPerByte(p));
+			}
+#			if PLATFORM_HAS_CYCLE_COUNTER
+			WriteCsvNumber(f, info, res.name, "perf", noDataSet, p.length, "cyclesPerHash", p.cyclesPerHash);
+			WriteCsvNumber(f, info, res.name, "perf", noDataSet, p.length, "cyclesPerByte", p.cyclesPerByte);
+#			endif
+		}
+	}
+	for (size_t ia = 0; ia < g_Results128.size(); ++ia)
+	{
+		const Result128& res = g_Results128[ia];
+		WriteCsvBloomFilters(f, info, res.name, res.bloomFilters);
+		for (size_t id = 0; id < res.cuckooTables.size(); ++id)
+		{
+			const Result128::CuckooTableResult& t = res.cuckooTables[id];
+			const Result128::CuckooFilterResult& fl = res.cuckooFilters[id];
+			if (t.loadFactor == 0)
+				continue;
+			const std::string& name = g_DataSets[id]->name;
+			WriteCsvNumber(f, info, res.name, "cuckootable", name, -1, "loadFactor", t.loadFactor);
+			WriteCsvNumber(f, info, res.name, "cuckootable", name, -1, "insertNs", t.insertNs);
+			WriteCsvNumber(f, info, res.name, "cuckootable", name, -1, "hitNs", t.hitNs);
+			WriteCsvNumber(f, info, res.name, "cuckootable", name, -1, "missNs", t.missNs);
+			WriteCsvNumber(f, info, res.name, "cuckootable", name, -1, "kicksMean", t.kicksMean);
+			WriteCsvNumber(f, info, res.name, "cuckootable", name, -1, "kicksMax", t.kicksMax);
+			WriteCsvNumber(f, info, res.name, "cuckoofilter", name, -1, "loadFactor", fl.loadFactor);
+			WriteCsvNumber(f, info, res.name, "cuckoofilter", name, -1, "insertNs", fl.insertNs);
+			WriteCsvNumber(f, info, res.name, "cuckoofilter", name, -1, "hitNs", fl.hitNs);
+			WriteCsvNumber(f, info, res.name, "cuckoofilter", name, -1, "missNs", fl.missNs);
+			WriteCsvNumber(f, info, res.name, "cuckoofilter", name, -1, "kicksMean", fl.kicksMean);
+			WriteCsvNumber(f, info, res.name, "cuckoofilter", name, -1, "kicksMax", fl.kicksMax);
+			WriteCsvNumber(f, info, res.name, "cuckoofilter", name, -1, "falsePositiveRate", fl.falsePositiveRate);
+			WriteCsvNumber(f, info, res.name, "cuckoofilter", name, -1, "expectedFalsePositiveRate", fl.expectedFalsePositiveRate);
+		}
+	}
+}
 
-struct HasherCRC32 : public Hasher32Bit
-{
-	HashType operator()(const void* data, size_t size) const { HashType res; crc32(data, (int)size, 0x1234, &res); return res; }
-};
-struct HasherMD5_32 : public Hasher32Bit
+static void WriteStructuredResults()
 {
-	HashType operator()(const void* data, size_t size) const
+	if (g_JsonOutputPath.empty() && g_CsvOutputPath.empty())
+		return;
+	RunInfo info;
+	GatherRunInfo(info);
+	if (!g_JsonOutputPath.empty())
 	{
-		// Could do this on Apple platforms, from <CommonCrypto/CommonDigest.h> -- quick test
-		// shows that it's around 25% faster, but that does not change things much.
-		//uint32_t res[4]; CC_MD5(data, (unsigned int)size, (unsigned char*)res); return res[0];
-		HashType res; md5_32(data, (int)size, 0x1234, &res); return res;
+		if (FILE* f = OpenOutputFile(g_JsonOutputPath))
+		{
+			WriteJsonResults(f, info);
+			CloseOutputFile(f);
+		}
 	}
-};
-struct HasherSHA1_32 : public Hasher32Bit
-{
-	HashType operator()(const void* data, size_t size) const
+	if (!g_CsvOutputPath.empty())
 	{
-		// Could do this on Apple platforms, from <CommonCrypto/CommonDigest.h> -- quick test
-		// shows that it's around 25% faster, but that does not change things much.
-		//uint32_t res[5]; CC_SHA1(data, (unsigned int)size, (unsigned char*)res); return res[0];
-		HashType res; sha1_32a(data, (int)size, 0x1234, &res); return res;
+		if (FILE* f = OpenOutputFile(g_CsvOutputPath))
+		{
+			WriteCsvResults(f, info);
+			CloseOutputFile(f);
+		}
 	}
-};
+}
 
 
 // ------------------------------------------------------------------------------------
-// Main program
-
-static std::vector<DataSet*> g_DataSets;
-static std::vector<uint8_t> g_SyntheticData;
-static std::vector<Result> g_Results;
+// Comparing against a baseline: a CSV file written earlier with --csv.
+// Any hashsum change is a correctness break. Per hash function, MB/s changes at
+// each length are judged against the spread of changes over all its lengths, so
+// that machine noise (which moves everything a bit) isn't reported as a regression.
+// When the baseline has sample statistics, medians are compared instead of best
+// values, and changes where the two confidence intervals overlap are not significant.
 
-typedef void (*TestHashQualityFunc)(const DataSet& dataset, Result::DataSetResult& outResult);
-typedef void (*TestHashPerfFunc)(const std::vector<uint8_t>& data, bool aligned, Result& outResult);
+static std::string g_BaselinePath;
+static float g_RegressionThreshold = 10.0f; // % slowdown at any length that fails the run
+const float kRegressionNoiseFloor = 2.0f; // % changes below this are never significant
+static int g_ExitCode = 0;
 
-struct HashToTest
+enum
 {
-	const char* name;
-	TestHashQualityFunc qualityFunc;
-	TestHashPerfFunc perfFunc;
-	bool excludeFromPerf;
+	kExitCodeHashsumChanged = 2,
+	kExitCodePerfRegression = 3,
 };
-static std::vector<HashToTest> g_Hashes;
 
-static void AddHash(const char* name, TestHashQualityFunc qualityFunc, TestHashPerfFunc perfFunc, bool excludeFromPerf)
+static void ParseCsvLine(const std::string& line, std::vector<std::string>& outFields)
 {
-	HashToTest h;
-	h.name = name;
-	h.qualityFunc = qualityFunc;
-	h.perfFunc = perfFunc;
-	h.excludeFromPerf = excludeFromPerf;
-	g_Hashes.push_back(h);
-}
-
-
-static void CreateSyntheticData()
-{
-	g_SyntheticData.resize(kSyntheticDataTotalSize);
-	for (size_t i = 0; i < kSyntheticDataTotalSize; ++i)
-		g_SyntheticData[i] = i;
+	outFields.clear();
+	std::string field;
+	bool quoted = false;
+	for (size_t i = 0; i < line.size(); ++i)
+	{
+		char c = line[i];
+		if (quoted)
+		{
+			if (c == '"' && i + 1 < line.size() && line[i+1] == '"')
+				field += line[++i];
+			else if (c == '"')
+				quoted = false;
+			else
+				field += c;
+		}
+		else if (c == '"')
+			quoted = true;
+		else if (c == ',')
+		{
+			outFields.push_back(field);
+			field.clear();
+		}
+		else if (c != '\r' && c != '\n')
+			field += c;
+	}
+	outFields.push_back(field);
 }
 
-static void LoadDataSets(const char* folderName)
+struct Baseline
 {
-	// Basic collisions / hash quality tests on some real world data I had lying around:
-	// - Dictionary of English words from /usr/share/dict/words
-	// - A bunch of file relative paths + filenames from several Unity projects & test suites.
-	//   Imaginary use case, hashing filenames in some asset database / file storage system.
-	// - C++ source code, this was partial Unity sourcecode dump. I'm not releasing this one :),
-	//   but it was 6069 entries, 43.7MB total size, average size 7546.6 bytes.
-	// - Mostly binary data. I instrumented hash function calls, as used in Unity engine graphics
-	//   related parts, to dump actually hashed data into a log file. Unlike the test sets above,
-	//   most of the data here is binary, and represents snapshots of some internal structs in
-	//   memory.
-	DataSet* data;
-	data = ReadDataSet(folderName, "TestData/test-words.txt"); if (data) g_DataSets.push_back(data);
-	data = ReadDataSet(folderName, "TestData/test-filenames.txt"); if (data) g_DataSets.push_back(data);
-	data = ReadDataSet(folderName, "TestData/test-code.txt"); if (data) g_DataSets.push_back(data);
-	data = ReadDataSet(folderName, "TestData/test-binary.bin"); if (data) g_DataSets.push_back(data);
-}
+	std::string gitRevision, timestamp, cpuModel;
+	std::map<std::string, std::string> hashsums; // "hash\tdataset" -> hashsum
+	std::map<std::string, std::map<int, double> > mbps; // hash -> length -> MB/s
+	std::map<std::string, std::map<int, SampleStats> > mbpsStats; // only median & CI; only in files with sample statistics
+};
 
-static void PrintResults()
+static bool ReadBaseline(const std::string& path, Baseline& out)
 {
-	fprintf(g_OutputFile, "**** Quality evaluation\n");
-	for (size_t id = 0; id < g_DataSets.size(); ++id)
+	FILE* f = fopen(path.c_str(), "rb");
+	if (!f)
 	{
-		const DataSet& data = *g_DataSets[id];
-		fprintf(g_OutputFile, "%s, %i entries, %.1f MB size, avg length %.1f\n", data.name.c_str(), (int)data.entries.size(), data.totalSize / 1024.0 / 1024.0, double(data.totalSize) / data.entries.size());
-		fprintf(g_OutputFile, "HashAlgorithm   Colis HTColsIncrease hashsum\n");
-		for (size_t ia = 0; ia < g_Results.size(); ++ia)
+		fprintf(g_OutputFile, "error: can't open baseline file '%s'\n", path.c_str());
+		return false;
+	}
+	std::vector<std::string> fields;
+	std::map<std::string, size_t> columns;
+	std::string line;
+	char buf[4096];
+	bool header = true;
+	while (fgets(buf, sizeof(buf), f))
+	{
+		line += buf;
+		if (line.empty() || line[line.size()-1] != '\n')
 		{
-			const Result::DataSetResult& res = g_Results[ia].datasets[id];
-			fprintf(g_OutputFile, "%15s %4i %6i           %08x\n", g_Results[ia].name.c_str(), res.collisions, (int)res.hashtabCollisionsIncrease, res.hashsum);
+			if (!feof(f))
+				continue;
+		}
+		ParseCsvLine(line, fields);
+		line.clear();
+		if (header)
+		{
+			for (size_t i = 0; i < fields.size(); ++i)
+				columns[fields[i]] = i;
+			header = false;
+			const char* kRequired[] = { "hash", "test", "dataset", "length", "metric", "value" };
+			for (size_t i = 0; i < sizeof(kRequired)/sizeof(kRequired[0]); ++i)
+			{
+				if (columns.find(kRequired[i]) == columns.end())
+				{
+					fprintf(g_OutputFile, "error: baseline file '%s' has no '%s' column\n", path.c_str(), kRequired[i]);
+					fclose(f);
+					return false;
+				}
+			}
+			continue;
+		}
+		if (fields.size() < columns.size())
+			continue;
+		const std::string& hash = fields[columns["hash"]];
+		const std::string& test = fields[columns["test"]];
+		const std::string& metric = fields[columns["metric"]];
+		const std::string& value = fields[columns["value"]];
+		if (out.timestamp.empty() && columns.count("timestamp"))
+		{
+			out.timestamp = fields[columns["timestamp"]];
+			out.gitRevision = columns.count("git_revision") ? fields[columns["git_revision"]] : "";
+			out.cpuModel = columns.count("cpu_model") ? fields[columns["cpu_model"]] : "";
+		}
+		if (test == "quality" && metric == "hashsum")
+			out.hashsums[hash + "\t" + fields[columns["dataset"]]] = value;
+		else if (test == "perf" && metric == "mbps" && !value.empty())
+			out.mbps[hash][atoi(fields[columns["length"]].c_str())] = atof(value.c_str());
+		else if (test == "perf" && (metric == "mbpsMedian" || metric == "mbpsCiLow" || metric == "mbpsCiHigh") && !value.empty())
+		{
+			SampleStats& st = out.mbpsStats[hash][atoi(fields[columns["length"]].c_str())];
+			(metric == "mbpsMedian" ? st.median : metric == "mbpsCiLow" ? st.ciLow : st.ciHigh) = atof(value.c_str());
 		}
 	}
+	fclose(f);
+	return true;
+}
 
-	fprintf(g_OutputFile, "\n**** Performance evaluation, MB/s\n");
-	fprintf(g_OutputFile, "DataSize,");
-	for (size_t ia = 0; ia < g_Hashes.size(); ++ia)
+// prints the comparison and sets g_ExitCode
+static void CompareWithBaseline()
+{
+	Baseline base;
+	if (!ReadBaseline(g_BaselinePath, base))
 	{
-		if (g_Hashes[ia].excludeFromPerf)
-			continue;
-		fprintf(g_OutputFile, "%s,", g_Hashes[ia].name);
+		g_ExitCode = 1;
+		return;
 	}
-	fprintf(g_OutputFile, "\n");
-	for (size_t is = 0; is < g_Results[0].mbpsPerLength.size(); ++is)
+	fprintf(g_OutputFile, "\n**** Comparison with baseline %s (revision %s, %s)\n", g_BaselinePath.c_str(), base.gitRevision.c_str(), base.timestamp.c_str());
+	RunInfo info;
+	GatherRunInfo(info);
+	if (!base.cpuModel.empty() && base.cpuModel != info.cpuModel)
+		fprintf(g_OutputFile, "warning: baseline was measured on a different CPU (%s)\n", base.cpuModel.c_str());
+
+	// correctness: hashsums must not change
+	int hashsumBreaks = 0;
+	for (size_t ia = 0; ia < g_Results.size() && g_RunQuality; ++ia)
 	{
-		fprintf(g_OutputFile, "%i,", g_Results[0].mbpsPerLength[is].length);
-		for (size_t ia = 0; ia < g_Results.size(); ++ia)
+		for (size_t id = 0; id < g_DataSets.size(); ++id)
 		{
-			if (g_Hashes[ia].excludeFromPerf)
+			std::map<std::string, std::string>::const_iterator it = base.hashsums.find(g_Results[ia].name + "\t" + g_DataSets[id]->name);
+			if (it == base.hashsums.end())
 				continue;
-			fprintf(g_OutputFile, "%i,", (int)g_Results[ia].mbpsPerLength[is].mbps);
+			char hashsum[16];
+			snprintf(hashsum, sizeof(hashsum), "%08x", g_Results[ia].datasets[id].hashsum);
+			if (it->second != hashsum)
+			{
+				fprintf(g_OutputFile, "HASHSUM CHANGED: %s on %s: %s -> %s\n", g_Results[ia].name.c_str(), g_DataSets[id]->name.c_str(), it->second.c_str(), hashsum);
+				++hashsumBreaks;
+			}
 		}
-		fprintf(g_OutputFile, "\n");
 	}
-	fprintf(g_OutputFile, "\n");
 
-	fprintf(g_OutputFile, "\n**** Aligned data performance evaluation, MB/s\n");
-	fprintf(g_OutputFile, "DataSize,");
-	for (size_t ia = 0; ia < g_Hashes.size(); ++ia)
+	// performance
+	int regressions = 0;
+	if (g_RunPerf)
 	{
-		if (g_Hashes[ia].excludeFromPerf)
-			continue;
-		fprintf(g_OutputFile, "%s,", g_Hashes[ia].name);
-	}
-	fprintf(g_OutputFile, "\n");
-	for (size_t is = 0; is < g_Results[0].mbpsPerLength.size(); ++is)
-	{
-		fprintf(g_OutputFile, "%i,", g_Results[0].mbpsPerLength[is].length);
+		fprintf(g_OutputFile, "HashAlgorithm   Lengths MedianDelta Noise  Significant changes (length: base -> now MB/s)\n");
 		for (size_t ia = 0; ia < g_Results.size(); ++ia)
 		{
-			if (g_Hashes[ia].excludeFromPerf)
+			const Result& res = g_Results[ia];
+			std::map<std::string, std::map<int, double> >::const_iterator baseIt = base.mbps.find(res.name);
+			if (res.mbpsPerLength.empty() || baseIt == base.mbps.end())
+				continue;
+			const std::map<int, SampleStats>& baseStats = base.mbpsStats[res.name];
+			std::vector<double> deltas, baseValues, values;
+			std::vector<bool> overlapping;
+			std::vector<size_t> deltaIndices;
+			for (size_t is = 0; is < res.mbpsPerLength.size(); ++is)
+			{
+				const Result::PerfResult& p = res.mbpsPerLength[is];
+				std::map<int, double>::const_iterator it = baseIt->second.find(p.length);
+				if (it == baseIt->second.end() || it->second <= 0)
+					continue;
+				double baseValue = it->second, value = p.mbps;
+				bool overlap = false;
+				std::map<int, SampleStats>::const_iterator st = baseStats.find(p.length);
+				if (st != baseStats.end() && st->second.median > 0 && p.mbpsStats.count > 0)
+				{
+					baseValue = st->second.median;
+					value = p.mbpsStats.median;
+					overlap = p.mbpsStats.ciLow <= st->second.ciHigh && st->second.ciLow <= p.mbpsStats.ciHigh;
+				}
+				deltas.push_back((value / baseValue - 1.0) * 100.0);
+				baseValues.push_back(baseValue);
+				values.push_back(value);
+				overlapping.push_back(overlap);
+				deltaIndices.push_back(is);
+			}
+			if (deltas.empty())
 				continue;
-			fprintf(g_OutputFile, "%i,", (int)g_Results[ia].mbpsPerLength[is].mbpsAligned);
+			// noise: 3x the (normal-scaled) median absolute deviation of the deltas
+			double median = Median(deltas);
+			std::vector<double> deviations(deltas.size());
+			for (size_t i = 0; i < deltas.size(); ++i)
+				deviations[i] = fabs(deltas[i] - median);
+			double noise = deltas.size() >= 3 ? 3.0 * 1.4826 * Median(deviations) : 0.0;
+			if (noise < kRegressionNoiseFloor)
+				noise = kRegressionNoiseFloor;
+
+			fprintf(g_OutputFile, "%15s %7i %+10.1f%% %4.1f%% ", res.name.c_str(), (int)deltas.size(), median, noise);
+			for (size_t i = 0; i < deltas.size(); ++i)
+			{
+				if (fabs(deltas[i]) <= noise || overlapping[i])
+					continue;
+				const Result::PerfResult& p = res.mbpsPerLength[deltaIndices[i]];
+				const bool regression = -deltas[i] > g_RegressionThreshold;
+				fprintf(g_OutputFile, " %i: %.0f -> %.0f (%+.0f%%)%s", p.length, baseValues[i], values[i], deltas[i], regression ? " REGRESSION" : "");
+				regressions += regression;
+			}
+			fprintf(g_OutputFile, "\n");
 		}
-		fprintf(g_OutputFile, "\n");
 	}
-	fprintf(g_OutputFile, "\n");
+
+	fprintf(g_OutputFile, "%i hashsum changes, %i performance regressions over %.0f%%\n", hashsumBreaks, regressions, g_RegressionThreshold);
+	if (hashsumBreaks)
+		g_ExitCode = kExitCodeHashsumChanged;
+	else if (regressions)
+		g_ExitCode = kExitCodePerfRegression;
 }
 
 extern "C" void HashFunctionsTestEntryPoint(const char* folderName)
 {
 	// load data
-	fprintf(g_OutputFile, "Loading data\n");
-	CreateSyntheticData();
-	LoadDataSets(folderName);
+	if (!g_ListHashes)
+	{
+		fprintf(g_OutputFile, "Loading data\n");
+		if (g_RunPerf)
+			CreateSyntheticData();
+		if (g_RunQuality || (g_RunPerf && (g_RunKeyMix || g_RunHashTable || g_RunSwissTable || g_RunRobinHood || g_RunCuckoo || g_RunBloom)))
+			LoadDataSets(folderName);
+		if (g_RunPerf && g_RunKeyMix)
+			CreateKeyMixes();
+		if (g_RunPerf && (g_RunHashTable || g_RunSwissTable || g_RunRobinHood || g_RunCuckoo || g_RunBloom))
+		{
+			g_DataSetKeys.resize(g_DataSets.size());
+			for (size_t id = 0; id < g_DataSets.size(); ++id)
+				GetDataSetKeys(*g_DataSets[id], kHashTableMaxKeys, g_DataSetKeys[id]);
+		}
+	}
+	if (g_PerfLengths.empty())
+		AddDefaultPerfLengths(g_PerfLengths);
 	g_Results.reserve(50);
 	
 	// setup hash functions to test
-#	define ADDHASH(name,clazz,exclude) AddHash(name, TestQualityOnDataSet<clazz>, TestPerformancePerLength<clazz>, exclude)
+#	define ADDHASH(name,clazz,exclude) AddHash(name, TestQualityOnDataSet<clazz>, CreateQualityAccumulator<clazz>, TestPerformancePerLength<clazz>, TestLatencyPerLength<clazz>, TestWorkingSetPerLength<clazz>, TestOffsetsPerLength<clazz>, TestKeyMix<clazz>, SCALING_TEST_FUNC(clazz), TestHashTables<clazz>, TestBloomFilter<clazz>, exclude)
 
 	ADDHASH("xxHash64", HasherXXH64, 0);
 	ADDHASH("xxHash64-32", HasherXXH64_32, 1);
@@ -529,72 +4604,541 @@ extern "C" void HashFunctionsTestEntryPoint(const char* folderName)
 
 #	undef ADDHASH
 
-	// do quality evaluations on all hash functions
-	fprintf(g_OutputFile, "Doing quality evals...\n  ");
+#	define ADDHASH128(name,clazz) AddHash128(name, TestCuckoo<clazz>, TestBloomFilter128<clazz>)
+	ADDHASH128("Murmur3-X64-128", Hasher128Murmur3_x64);
+	ADDHASH128("SpookyV2-128", Hasher128SpookyV2);
+	ADDHASH128("City128", Hasher128City);
+	ADDHASH128("Farm128", Hasher128Farm);
+#	undef ADDHASH128
+
+	if (g_ListHashes)
+	{
+		for (size_t i = 0; i < g_Hashes.size(); ++i)
+			fprintf(g_OutputFile, "%s%s\n", g_Hashes[i].name, g_Hashes[i].excludeFromPerf ? " (quality only)" : "");
+		for (size_t i = 0; i < g_Hashes128.size(); ++i)
+			fprintf(g_OutputFile, "%s (--cuckoo & --bloom only)\n", g_Hashes128[i].name);
+		return;
+	}
+	for (size_t i = 0; i < g_HashFilters.size(); ++i)
+	{
+		bool found = false;
+		for (size_t j = 0; j < g_Hashes.size() && !found; ++j)
+			found = MatchWildcard(g_HashFilters[i].c_str(), g_Hashes[j].name);
+		for (size_t j = 0; j < g_Hashes128.size() && !found; ++j)
+			found = MatchWildcard(g_HashFilters[i].c_str(), g_Hashes128[j].name);
+		if (!found)
+			fprintf(g_OutputFile, "warning: no hash function matches '%s'\n", g_HashFilters[i].c_str());
+	}
+
+	// do quality evaluations on all hash functions; each (hash, dataset) pair is an
+	// independent task writing into its own preallocated result slot
 	for (size_t i = 0; i < g_Hashes.size(); ++i)
 	{
-		const HashToTest& hash = g_Hashes[i];
 		g_Results.push_back(Result());
 		Result& res = g_Results.back();
-		res.name = hash.name;
+		res.name = g_Hashes[i].name;
 		res.datasets.resize(g_DataSets.size());
-		fprintf(g_OutputFile, "%s ", hash.name);
+	}
+	if (g_RunQuality)
+	{
+		fprintf(g_OutputFile, "Doing quality evals...\n  ");
+		for (size_t i = 0; i < g_Hashes.size(); ++i)
+			fprintf(g_OutputFile, "%s ", g_Hashes[i].name);
 		fflush(g_OutputFile);
-		for (size_t id = 0, nd = g_DataSets.size(); id != nd; ++id)
+		TaskScheduler scheduler(g_WorkerThreadCount);
+		std::vector<size_t> shardCounts(g_DataSets.size());
+		for (size_t id = 0; id < g_DataSets.size(); ++id)
+			shardCounts[id] = GetQualityShardCount(*g_DataSets[id], g_CollisionEngine, scheduler.GetThreadCount());
+		scheduler.RunTasks(g_Hashes.size() * g_DataSets.size(), QualityTask, &shardCounts);
+		for (size_t id = 0; id < g_DataSets.size(); ++id)
+		{
+#			if DATASET_STREAMING
+			if (g_DataSets[id]->IsStreamed())
+			{
+				TestQualityOnStreamedDataSet(id, scheduler);
+				continue;
+			}
+#			endif
+			if (shardCounts[id] > 1)
+				TestQualityInShards(id, shardCounts[id], scheduler);
+		}
+		fprintf(g_OutputFile, "\n");
+		if (g_RunReductionSweep)
 		{
-			hash.qualityFunc(*g_DataSets[id], res.datasets[id]);
+			MeasureReductionCosts<uint32_t>(g_ReductionNsPerHash[0]);
+			MeasureReductionCosts<uint64_t>(g_ReductionNsPerHash[1]);
 		}
 	}
-	fprintf(g_OutputFile, "\n");
 
 	// Do performance evaluations on all hash functions.
 	// Perform several iterations: for (iterations) { for (hashes) { DoPerfTest } }.
 	// Iterations are performed in the outer loop, so that any clock changes affect
 	// all hash functions in a fair way.
-	fprintf(g_OutputFile, "Doing performance evals...\n");
-	for (int iter = 0; iter < kSyntheticDataIterations; ++iter)
+	if (g_RunPerf)
 	{
-		fprintf(g_OutputFile, "  iter %i/%i\n", iter+1, kSyntheticDataIterations);
-		for (size_t i = 0; i < g_Hashes.size(); ++i)
+		fprintf(g_OutputFile, "Doing performance evals...\n");
+#		if PLATFORM_LINUX
+		if (g_PerfAffinityCpu >= 0)
+			SetAffinity(g_PerfAffinityCpu);
+#		endif
+		if (g_PerfCountersEnabled)
 		{
-			const HashToTest& hash = g_Hashes[i];
-			if (hash.excludeFromPerf)
-				continue;
-			Result& res = g_Results[i];
-			hash.perfFunc(g_SyntheticData, false, res);
+			if (g_PerfCounterGroup.Open())
+				fprintf(g_OutputFile, "  hardware counters: %s\n", g_PerfCounterGroup.GetAvailableNames().c_str());
+			else
+				fprintf(g_OutputFile, "warning: hardware performance counters not available (needs Linux perf_event_open, and a PMU visible to this machine/VM)\n");
 		}
-	}
-	fprintf(g_OutputFile, "  aligned data...\n");
-	for (int iter = 0; iter < kSyntheticDataIterations; ++iter)
-	{
-		fprintf(g_OutputFile, "  iter %i/%i\n", iter+1, kSyntheticDataIterations);
-		for (size_t i = 0; i < g_Hashes.size(); ++i)
+		RunPerfIterations(false);
+		fprintf(g_OutputFile, "  aligned data...\n");
+		RunPerfIterations(true);
+		if (g_RunLatency)
 		{
-			const HashToTest& hash = g_Hashes[i];
-			if (hash.excludeFromPerf)
-				continue;
-			Result& res = g_Results[i];
-			hash.perfFunc(g_SyntheticData, true, res);
+			fprintf(g_OutputFile, "  latency...\n");
+			for (int iter = 0; iter < g_PerfIterations; ++iter)
+			{
+				fprintf(g_OutputFile, "  iter %i/%i\n", iter+1, g_PerfIterations);
+				for (size_t i = 0; i < g_Hashes.size(); ++i)
+				{
+					if (!g_Hashes[i].excludeFromPerf)
+						g_Hashes[i].latencyFunc(g_SyntheticData, g_Results[i]);
+				}
+			}
+		}
+		if (g_RunKeyMix)
+		{
+			fprintf(g_OutputFile, "  key mixes...\n");
+			for (int iter = 0; iter < g_PerfIterations; ++iter)
+			{
+				fprintf(g_OutputFile, "  iter %i/%i\n", iter+1, g_PerfIterations);
+				for (size_t i = 0; i < g_Hashes.size(); ++i)
+				{
+					if (g_Hashes[i].excludeFromPerf)
+						continue;
+					for (size_t im = 0; im < g_KeyMixes.size(); ++im)
+						g_Hashes[i].keyMixFunc(im, g_Results[i]);
+				}
+			}
+		}
+		if (g_RunHashTable || g_RunSwissTable || g_RunRobinHood)
+		{
+			fprintf(g_OutputFile, "  hash tables...\n");
+			for (int iter = 0; iter < g_PerfIterations; ++iter)
+			{
+				fprintf(g_OutputFile, "  iter %i/%i\n", iter+1, g_PerfIterations);
+				for (size_t i = 0; i < g_Hashes.size(); ++i)
+				{
+					if (g_Hashes[i].excludeFromPerf)
+						continue;
+					for (size_t id = 0; id < g_DataSetKeys.size(); ++id)
+						g_Hashes[i].hashTableFunc(id, g_Results[i]);
+				}
+			}
+		}
+		if ((g_RunCuckoo || g_RunBloom) && !g_Hashes128.empty())
+		{
+			g_Results128.resize(g_Hashes128.size());
+			for (size_t i = 0; i < g_Hashes128.size(); ++i)
+				g_Results128[i].name = g_Hashes128[i].name;
 		}
+		if (g_RunCuckoo && !g_Hashes128.empty())
+		{
+			fprintf(g_OutputFile, "  cuckoo table & filter...\n");
+			for (int iter = 0; iter < g_PerfIterations; ++iter)
+			{
+				fprintf(g_OutputFile, "  iter %i/%i\n", iter+1, g_PerfIterations);
+				for (size_t i = 0; i < g_Hashes128.size(); ++i)
+				{
+					for (size_t id = 0; id < g_DataSetKeys.size(); ++id)
+						g_Hashes128[i].cuckooFunc(id, g_Results128[i]);
+				}
+			}
+		}
+		if (g_RunBloom)
+		{
+			fprintf(g_OutputFile, "  bloom filters...\n");
+			for (int iter = 0; iter < g_PerfIterations; ++iter)
+			{
+				fprintf(g_OutputFile, "  iter %i/%i\n", iter+1, g_PerfIterations);
+				for (size_t i = 0; i < g_Hashes.size(); ++i)
+				{
+					if (g_Hashes[i].excludeFromPerf)
+						continue;
+					for (size_t id = 0; id < g_DataSetKeys.size(); ++id)
+						g_Hashes[i].bloomFunc(id, g_Results[i]);
+				}
+				for (size_t i = 0; i < g_Hashes128.size(); ++i)
+				{
+					for (size_t id = 0; id < g_DataSetKeys.size(); ++id)
+						g_Hashes128[i].bloomFunc(id, g_Results128[i]);
+				}
+			}
+		}
+		if (g_RunOffsetSweep)
+		{
+			fprintf(g_OutputFile, "  misaligned data...\n");
+			for (int iter = 0; iter < g_PerfIterations; ++iter)
+			{
+				fprintf(g_OutputFile, "  iter %i/%i\n", iter+1, g_PerfIterations);
+				for (size_t i = 0; i < g_Hashes.size(); ++i)
+				{
+					if (!g_Hashes[i].excludeFromPerf)
+						g_Hashes[i].offsetsFunc(g_SyntheticData, g_Results[i]);
+				}
+			}
+		}
+		if (!g_WorkingSetSizes.empty())
+			RunWorkingSetSweep();
+#		if SCALING_TEST
+		if (g_ScalingMaxThreads >= 0)
+		{
+			fprintf(g_OutputFile, "  thread scaling...\n");
+			RunScalingTest();
+		}
+#		endif
+		ComputePerfStats();
 	}
 
 	// print results
 	PrintResults();
+	WriteStructuredResults();
+	if (!g_BaselinePath.empty())
+		CompareWithBaseline();
 }
 
 
 // iOS & XB1 has main entry points elsewhere
 #if !PLATFORM_IOS && !PLATFORM_XBOXONE && !PLATFORM_ANDROID
 
-int main()
+static void PrintUsage()
+{
+	fprintf(stderr,
+		"usage: hashtest [options]\n"
+		"  --hashes=LIST         hash functions to test, comma separated names; * and ? wildcards (default: all)\n"
+		"  --list                list the (matching) hash functions and exit\n"
+		"  --datasets=LIST       comma separated dataset files to use instead of TestData ones\n"
+		"  --lengths=LIST        data lengths for performance tests, comma separated: N, A-B or A-B:STEP\n"
+		"                        (default: 2..4803, growing geometrically)\n"
+		"  --dense[=LIST]        test every length 0..256 (or LIST, written as for --lengths; instead of\n"
+		"                        --lengths), and report performance cliffs (also done for contiguous --lengths)\n"
+		"  --cliff-threshold=PCT MB/s drop between neighbouring lengths reported as a cliff (default: %.0f)\n"
+		"  --iterations=N        performance test iterations (default: %i); minimum in adaptive mode\n"
+		"  --target-ci=PCT       adaptive mode: iterate until the 95%% confidence interval of median MB/s is\n"
+		"                        narrower than PCT %% of the median, for every length\n"
+		"  --max-iterations=N    adaptive mode iteration limit (default: %i)\n"
+		"  --quality-only        only do hash quality tests\n"
+		"  --perf-only           only do performance tests\n"
+		"  --threads=N           worker threads for quality tests & data loading (default: 0, all cores)\n"
+		"  --key-mix             also measure keys/s hashing data set entries (in file order and shuffled),\n"
+		"                        and keys with Zipf distributed lengths\n"
+		"  --zipf=S              Zipf exponent for the above (default: 1.0)\n"
+		"  --hashtable           also measure ns/insert and ns/lookup (present & missing keys) of data set\n"
+		"                        entries in a linear probing hash table, with probe length statistics\n"
+		"  --swiss-table         same in a Swiss table (SSE2 matched 7 bit tags), with tag false positive rates\n"
+		"  --robin-hood          same in a Robin Hood table at load factors 0.5 .. 0.95, with probe length\n"
+		"                        distributions (mean, p99, max)\n"
+		"  --cuckoo              also measure a cuckoo table & cuckoo filter with both bucket choices from\n"
+		"                        one 128 bit hash: load factor reached, kicks/insert, ns/lookup, filter false\n"
+		"                        positive rate vs. theory. Uses the 128 bit hash functions (see --list)\n"
+		"  --bloom               also measure queries/s and false positive rate vs. theory of a blocked Bloom\n"
+		"                        filter (10 bits/key, k=7), with k separate hash calls (each over an 8 byte\n"
+		"                        salt + the key, so key length + 8 bytes) vs. double hashing of one call, and\n"
+		"                        one by one vs. batched (hash all, prefetch all, then test) queries\n"
+		"  --offset-sweep        also measure MB/s with keys at every offset 0..63 within a cache line,\n"
+		"                        and with keys straddling 4KB pages\n"
+		"  --cache-sweep         also measure MB/s on working sets of 16KB, 256KB, 4MB, 64MB and 1GB\n"
+		"  --working-sets=LIST   working set sizes for the above, comma separated, with K/M/G suffixes\n"
+		"  --huge-pages          back working set buffers with 2MB pages (Linux)\n"
+		"  --scaling[=N]         also measure aggregate MB/s on 1, 2, 4 .. N threads (default: all CPUs), each\n"
+		"                        pinned to a CPU and hashing its own buffer\n"
+		"  --smt-siblings        place scaling test threads on all SMT siblings of a core before the next core\n"
+		"                        (default: one thread per physical core first)\n"
+		"  --scaling-size=SIZE   buffer size per scaling test thread, with K/M/G suffix (default: 16M)\n"
+		"  --latency             also measure hash latency, with each hash input depending on the previous hash\n"
+		"  --counters            collect hardware performance counters during performance tests (Linux)\n"
+		"  --cpu=N               CPU core to pin performance tests to, -1 to not pin (default: %i)\n"
+		"  --collisions=ENGINE   collision counting: sort (default), set, estimate; streamed datasets\n"
+		"                        use estimate (fixed memory use) unless this is given\n"
+		"  --reduction-sweep     also count hashtable collisions at load factors 0.25 .. 1 for mask, prime modulo,\n"
+		"                        fastrange and Fibonacci bucket index reductions, and time each reduction\n"
+		"  --no-mmap             read datasets into memory instead of mapping them\n"
+		"  --no-index            don't use or write .idx dataset index files\n"
+		"  --stream-threshold=N  stream datasets larger than N bytes instead of loading them (default: %llu)\n"
+		"  --json=FILE           also write results & run info as JSON to FILE (- for stdout)\n"
+		"  --csv=FILE            also write results & run info as CSV to FILE, one value per row (- for stdout)\n"
+		"                        (with - the text report goes to stderr instead)\n"
+		"  --baseline=FILE       compare with results from an earlier --csv run; exit code %i if any hashsum\n"
+		"                        changed, %i if MB/s at any length dropped (significantly) by more than --max-slowdown\n"
+		"  --max-slowdown=PCT    allowed slowdown vs baseline, in percent (default: %.0f)\n",
+		g_CliffThreshold, kSyntheticDataIterations, g_PerfMaxIterations, g_PerfAffinityCpu, (unsigned long long)g_DataSetStreamThreshold,
+		kExitCodeHashsumChanged, kExitCodePerfRegression, g_RegressionThreshold);
+}
+
+static void SplitList(const std::string& str, std::vector<std::string>& out)
+{
+	size_t start = 0;
+	while (start <= str.size())
+	{
+		size_t end = str.find(',', start);
+		if (end == std::string::npos)
+			end = str.size();
+		if (end > start)
+			out.push_back(str.substr(start, end - start));
+		start = end + 1;
+	}
+}
+
+static bool ParseInt(const std::string& str, long long minValue, long long& outValue)
+{
+	char* end = NULL;
+	outValue = strtoll(str.c_str(), &end, 10);
+	return !str.empty() && *end == 0 && outValue >= minValue;
+}
+
+static bool ParseFloat(const std::string& str, float& outValue)
+{
+	char* end = NULL;
+	outValue = (float)strtod(str.c_str(), &end);
+	return !str.empty() && *end == 0 && outValue >= 0;
+}
+
+// comma separated byte sizes, with optional K, M or G (binary) suffixes
+static bool ParseSizes(const std::string& str, std::vector<size_t>& out)
+{
+	std::vector<std::string> items;
+	SplitList(str, items);
+	out.clear();
+	for (size_t i = 0; i < items.size(); ++i)
+	{
+		std::string item = items[i];
+		int shift = 0;
+		char suffix = item.empty() ? 0 : (char)toupper((unsigned char)item[item.size()-1]);
+		if (suffix == 'K' || suffix == 'M' || suffix == 'G')
+		{
+			shift = suffix == 'K' ? 10 : suffix == 'M' ? 20 : 30;
+			item.erase(item.size()-1);
+		}
+		long long size;
+		if (!ParseInt(item, 1, size))
+			return false;
+		out.push_back((size_t)size << shift);
+	}
+	return !out.empty();
+}
+
+// "N", "A-B" or "A-B:STEP" items
+static bool ParseLengths(const std::string& str, std::vector<int>& out)
+{
+	std::vector<std::string> items;
+	SplitList(str, items);
+	for (size_t i = 0; i < items.size(); ++i)
+	{
+		std::string item = items[i];
+		long long step = 1, first, last;
+		size_t colon = item.find(':');
+		if (colon != std::string::npos)
+		{
+			if (!ParseInt(item.substr(colon + 1), 1, step))
+				return false;
+			item.erase(colon);
+		}
+		size_t dash = item.find('-');
+		if (dash == std::string::npos)
+		{
+			if (!ParseInt(item, 0, first))
+				return false;
+			last = first;
+		}
+		else if (!ParseInt(item.substr(0, dash), 0, first) || !ParseInt(item.substr(dash + 1), first, last))
+			return false;
+		if (last >= (long long)kSyntheticDataTotalSize)
+			return false;
+		for (long long len = first; len <= last; len += step)
+			out.push_back((int)len);
+	}
+	return !out.empty();
+}
+
+static bool ParseCommandLine(int argc, char** argv)
+{
+	bool lengthsGiven = false;
+	for (int i = 1; i < argc; ++i)
+	{
+		std::string arg = argv[i];
+		std::string value;
+		size_t eq = arg.find('=');
+		if (eq != std::string::npos)
+		{
+			value = arg.substr(eq + 1);
+			arg.erase(eq);
+		}
+		// options with a value also accept it as the next argument
+		bool needsValue = arg == "--hashes" || arg == "--datasets" || arg == "--lengths" || arg == "--iterations" ||
+			arg == "--threads" || arg == "--cpu" || arg == "--collisions" || arg == "--stream-threshold" ||
+			arg == "--json" || arg == "--csv" || arg == "--baseline" || arg == "--max-slowdown" ||
+			arg == "--target-ci" || arg == "--max-iterations" || arg == "--working-sets" || arg == "--zipf" ||
+			arg == "--cliff-threshold" || arg == "--scaling-size";
+		if (needsValue && eq == std::string::npos)
+		{
+			if (i + 1 >= argc)
+			{
+				fprintf(stderr, "error: %s needs a value\n", arg.c_str());
+				return false;
+			}
+			value = argv[++i];
+		}
+
+		long long num = 0;
+		bool ok = true;
+		if (arg == "--help" || arg == "-h")
+		{
+			PrintUsage();
+			exit(0);
+		}
+		else if (arg == "--hashes")
+			SplitList(value, g_HashFilters);
+		else if (arg == "--list")
+			g_ListHashes = true;
+		else if (arg == "--datasets")
+			SplitList(value, g_DataSetFiles);
+		else if (arg == "--lengths")
+			ok = ParseLengths(value, g_PerfLengths), lengthsGiven = true;
+		else if (arg == "--dense")
+		{
+			ok = ParseLengths(eq == std::string::npos ? "0-256" : value, g_PerfLengths);
+			g_PerfLengthsDense = true;
+		}
+		else if (arg == "--cliff-threshold")
+			ok = ParseFloat(value, g_CliffThreshold);
+		else if (arg == "--iterations")
+			ok = ParseInt(value, 1, num), g_PerfIterations = (int)num;
+		else if (arg == "--key-mix")
+			g_RunKeyMix = true;
+		else if (arg == "--zipf")
+			ok = ParseFloat(value, g_ZipfExponent);
+		else if (arg == "--hashtable")
+			g_RunHashTable = true;
+		else if (arg == "--swiss-table")
+			g_RunSwissTable = true;
+		else if (arg == "--robin-hood")
+			g_RunRobinHood = true;
+		else if (arg == "--cuckoo")
+			g_RunCuckoo = true;
+		else if (arg == "--bloom")
+			g_RunBloom = true;
+		else if (arg == "--offset-sweep")
+			g_RunOffsetSweep = true;
+		else if (arg == "--cache-sweep")
+		{
+			const size_t kDefaultSizes[] = { 16 << 10, 256 << 10, 4 << 20, 64 << 20, 1 << 30 };
+			g_WorkingSetSizes.assign(kDefaultSizes, kDefaultSizes + sizeof(kDefaultSizes)/sizeof(kDefaultSizes[0]));
+		}
+		else if (arg == "--working-sets")
+			ok = ParseSizes(value, g_WorkingSetSizes);
+		else if (arg == "--huge-pages")
+			g_WorkingSetHugePages = true;
+		else if (arg == "--scaling")
+		{
+			g_ScalingMaxThreads = 0;
+			if (eq != std::string::npos)
+				ok = ParseInt(value, 1, num), g_ScalingMaxThreads = (int)num;
+		}
+		else if (arg == "--smt-siblings")
+			g_ScalingSmtSiblingsFirst = true;
+		else if (arg == "--scaling-size")
+		{
+			std::vector<size_t> sizes;
+			ok = ParseSizes(value, sizes) && sizes.size() == 1;
+			if (ok)
+				g_ScalingBufferSize = sizes[0];
+		}
+		else if (arg == "--latency")
+			g_RunLatency = true;
+		else if (arg == "--counters")
+			g_PerfCountersEnabled = true;
+		else if (arg == "--quality-only")
+			g_RunPerf = false;
+		else if (arg == "--perf-only")
+			g_RunQuality = false;
+		else if (arg == "--threads")
+			ok = ParseInt(value, 0, num), g_WorkerThreadCount = (int)num;
+		else if (arg == "--cpu")
+			ok = ParseInt(value, -1, num), g_PerfAffinityCpu = (int)num;
+		else if (arg == "--reduction-sweep")
+			g_RunReductionSweep = true;
+		else if (arg == "--collisions")
+		{
+			if (value == "sort")
+				g_CollisionEngine = kCollisionEngineSort;
+			else if (value == "set")
+				g_CollisionEngine = kCollisionEngineSet;
+			else if (value == "estimate")
+				g_CollisionEngine = kCollisionEngineEstimate;
+			else
+				ok = false;
+			g_StreamCollisionEngine = g_CollisionEngine;
+		}
+		else if (arg == "--no-mmap")
+			g_DataSetMmap = false;
+		else if (arg == "--no-index")
+			g_DataSetIndex = false;
+		else if (arg == "--stream-threshold")
+			ok = ParseInt(value, 0, num), g_DataSetStreamThreshold = (uint64_t)num;
+		else if (arg == "--json")
+			g_JsonOutputPath = value;
+		else if (arg == "--csv")
+			g_CsvOutputPath = value;
+		else if (arg == "--baseline")
+			g_BaselinePath = value;
+		else if (arg == "--max-slowdown")
+			ok = ParseFloat(value, g_RegressionThreshold);
+		else if (arg == "--target-ci")
+			ok = ParseFloat(value, g_PerfTargetCI);
+		else if (arg == "--max-iterations")
+			ok = ParseInt(value, 1, num), g_PerfMaxIterations = (int)num;
+		else
+		{
+			fprintf(stderr, "error: unknown option '%s'\n", argv[i]);
+			PrintUsage();
+			return false;
+		}
+		if (!ok)
+		{
+			fprintf(stderr, "error: invalid value '%s' for %s\n", value.c_str(), arg.c_str());
+			return false;
+		}
+	}
+	if (!g_RunQuality && !g_RunPerf)
+	{
+		fprintf(stderr, "error: --quality-only and --perf-only can't be used together\n");
+		return false;
+	}
+	if (lengthsGiven && g_PerfLengthsDense)
+	{
+		fprintf(stderr, "error: --dense and --lengths can't be used together, use --dense=LIST for custom lengths\n");
+		return false;
+	}
+	if (g_JsonOutputPath == "-" && g_CsvOutputPath == "-")
+	{
+		fprintf(stderr, "error: --json and --csv can't both be written to stdout\n");
+		return false;
+	}
+	// keep a structured stream on stdout parseable: the text report goes to stderr then
+	if (g_JsonOutputPath == "-" || g_CsvOutputPath == "-")
+		g_OutputFile = stderr;
+	return true;
+}
+
+int main(int argc, char** argv)
 {
+	if (!ParseCommandLine(argc, argv))
+		return 1;
 	#if PLATFORM_PS4
 	const char* folderName = "/app0/";
 	#else
 	const char* folderName = "";
 	#endif
 	HashFunctionsTestEntryPoint(folderName);
-	return 0;
+	return g_ExitCode;
 }
 
 #endif // #if !PLATFORM_IOS && !PLATFORM_XBOXONE && !PLATFORM_ANDROID